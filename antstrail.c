@@ -31,11 +31,29 @@
  *
  */
 
+# define _GNU_SOURCE
 # include <stdio.h>
 # include <stdlib.h>
 # include <math.h>
+# ifndef ANTSTRAIL_LIBRARY
 # include <glsc.h>
+# endif
 # include <time.h>
+# include <string.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/mman.h>
+# include <sys/resource.h>
+# include <sys/stat.h>
+# include <sys/time.h>
+# include <sys/wait.h>
+# include <sched.h>
+# include <pthread.h>
+# include <signal.h>
+# include <poll.h>
+# include <sys/socket.h>
+# include <sys/un.h>
+# include "antstrail.h"
 
 /*
  *
@@ -62,13 +80,70 @@ typedef struct {
 	/* threshold of pheromone detection */
 	int threshold[2];
 
+	/* 1 if it drew the sensitive thresholds, 0 the insensitive ones */
+	int isSensitive;
+
 	/* whether this ant has found food or not */
 	int hasFood;
 
 	/* whether this ant has come back or not */
 	int hasComeBack;
+
+	/* which colony it belongs to */
+	int colony;
 } ant;
 
+/* colony */
+typedef struct {
+	/* nest in hex */
+	int nestX;
+	int nestY;
+
+	/* number of ants, the sum over colonies is ANT_NUM */
+	int population;
+
+	/* steps between two ants coming out while the colony grows */
+	double lug;
+
+	/* which pheromone pair it uses: 0 ~ SPECIES_NUM - 1 */
+	int species;
+
+	/* ants of this colony are antList[first] ~ antList[first + population - 1] */
+	int first;
+
+	/* how many ants are out, and steps since the last one came out */
+	int count;
+	int tempCount;
+
+	/* homing statistics */
+	int comeBack;
+	int totalAnt;
+} colony;
+
+/* parameters that can change at run time, the defaults are the defines */
+typedef struct {
+	double thresholdOneSensitive;
+	double thresholdOneInsensitive;
+	double thresholdTwoSensitive;
+	double thresholdTwoInsensitive;
+	double pheromoneReleaseOne;
+	double pheromoneReleaseTwo;
+	double diffusionCoefOne;
+	double evaporateCoefOne;
+	double diffusionCoefTwo;
+	double evaporateCoefTwo;
+
+	/* steps between convergence checks (0 never stops early), */
+	/* largest changes still counted as settled, and checks in a row */
+	double convergeWindow;
+	double convergeTolerance;
+	double convergeFieldTolerance;
+	double convergePatience;
+
+	/* layout from the scenario library, -1 for the built-in one */
+	double scenario;
+} parameter;
+
 /*
  *
  * DEFINE
@@ -83,8 +158,11 @@ typedef struct {
 # define OBSTACLE_NUM (10)
 # define OBSTACLE_SURROUNDING (1)
 # define OBSTACLE_MODE (0)
+# define OBSTACLE_FILE "obstacle.pbm"
 # define MAX_PROCEDURE (N * 2000)
 # define FPS (0)
+# define RENDER_INTERVAL (1)
+# define FRAME_SCALE (2)
 # define LUG (N / (double)ANT_NUM)
 # define THRESHOLD_ONE_SENSITIVE (40.0)
 # define THRESHOLD_ONE_INSENSITIVE (80.0)
@@ -99,20 +177,67 @@ typedef struct {
 # define EVAPORATE_COEF_TWO (0.999)
 # define SET_SEED (-1)
 # define DOES_SET_FOOD (0)
+# define COLONY_NUM (1)
+# define SPECIES_NUM (1)
+# define ENGINE (0)
+# define MEAN_FIELD_MODE (0)
+# define PROFILE (0)
+# define PROFILE_INTERVAL (N)
+# define PROFILE_SAMPLE (10)
+# define DRAW (1)
+# define BENCH_MIN_TIME (0.2)
+# define SERIES_BUFFER (256)
+# define WRITE_CSV (1)
+# define CHECKPOINT_INTERVAL (N * 100)
+# define SWEEP_SET_MAX (4096)
+# define ENSEMBLE_INTERVAL (N)
+# define CONVERGE_WINDOW (0)
+# define CONVERGE_TOLERANCE (0.001)
+# define CONVERGE_FIELD_TOLERANCE (0.01)
+# define CONVERGE_PATIENCE (5)
+# define CACHE (1)
+# define CACHE_DIR ".antscache"
+# define TRAJECTORY (0)
+# define TRAJECTORY_BUFFER (1 << 20)
+# define HEATMAP_INTERVAL (0)
+# define HEATMAP_WORKERS (2)
+# define HEATMAP_QUEUE (8)
+# define TELEMETRY (0)
+# define TELEMETRY_INTERVAL (1)
+# define TELEMETRY_RING (4096)
+# define TELEMETRY_THUMBNAIL (16)
+# define JOB_MAX (4096)
+# define JOB_WORKERS (0)
+# define JOB_SOCKET "antstrail.sock"
+# define ARENA_PAGES (1)
+# define ARENA_ALIGN (64)
+# define SCENARIO (-1)
+# define SCENARIO_FILE "scenarios.scn"
+# define SAVE_FIELD (0)
+# define WARM_FILE ""
+# define WARM_ANTS (0)
  /*
 
 /* IT WORKS */
 
+/* L_MAX, ANT_NUM and SET_SEED can be given by -D (see bench.sh) */
+# ifndef L_MAX
 # define L_MAX (30)
+# endif
+# ifndef ANT_NUM
 # define ANT_NUM (50)
+# endif
 # define N (200)
 # define FOOD_NUM (3)
 # define SURROUNDING_MODE (0)
-# define OBSTACLE_NUM (10);
+# define OBSTACLE_NUM (10)
 # define OBSTACLE_SURROUNDING (1)
 # define OBSTACLE_MODE (0)
+# define OBSTACLE_FILE "obstacle.pbm"
 # define MAX_PROCEDURE (N * 100)
 # define FPS (0)
+# define RENDER_INTERVAL (1)
+# define FRAME_SCALE (2)
 # define LUG (N / (double)ANT_NUM)
 # define THRESHOLD_ONE_SENSITIVE (40.0)
 # define THRESHOLD_ONE_INSENSITIVE (80.0)
@@ -125,8 +250,49 @@ typedef struct {
 # define EVAPORATE_COEF_ONE (0.997)
 # define DIFFUSION_COEF_TWO (0.000001 / 6.0)
 # define EVAPORATE_COEF_TWO (0.999)
+# ifndef SET_SEED
 # define SET_SEED (-1)
+# endif
 # define DOES_SET_FOOD (0)
+# define COLONY_NUM (1)
+# define SPECIES_NUM (1)
+# define ENGINE (0)
+# define MEAN_FIELD_MODE (0)
+# define PROFILE (0)
+# define PROFILE_INTERVAL (N)
+# define PROFILE_SAMPLE (10)
+# define DRAW (1)
+# define BENCH_MIN_TIME (0.2)
+# define SERIES_BUFFER (256)
+# define WRITE_CSV (1)
+# define CHECKPOINT_INTERVAL (N * 10)
+# define SWEEP_SET_MAX (4096)
+# define ENSEMBLE_INTERVAL (N)
+# define CONVERGE_WINDOW (0)
+# define CONVERGE_TOLERANCE (0.001)
+# define CONVERGE_FIELD_TOLERANCE (0.01)
+# define CONVERGE_PATIENCE (5)
+# define CACHE (1)
+# define CACHE_DIR ".antscache"
+# define TRAJECTORY (0)
+# define TRAJECTORY_BUFFER (1 << 20)
+# define HEATMAP_INTERVAL (0)
+# define HEATMAP_WORKERS (2)
+# define HEATMAP_QUEUE (8)
+# define TELEMETRY (0)
+# define TELEMETRY_INTERVAL (1)
+# define TELEMETRY_RING (4096)
+# define TELEMETRY_THUMBNAIL (16)
+# define JOB_MAX (4096)
+# define JOB_WORKERS (0)
+# define JOB_SOCKET "antstrail.sock"
+# define ARENA_PAGES (1)
+# define ARENA_ALIGN (64)
+# define SCENARIO (-1)
+# define SCENARIO_FILE "scenarios.scn"
+# define SAVE_FIELD (0)
+# define WARM_FILE ""
+# define WARM_ANTS (0)
 
  /* */
 
@@ -137,34 +303,648 @@ typedef struct {
  */
 
 /* stores actual xy coordinates of hex - coordinate */
-double coordinate[L_MAX * 2 + 1][L_MAX * 2 + 1][2];
+double (*coordinate)[L_MAX * 2 + 1][2];
+
+/* Pheromone: species s uses 2 * s (one) and 2 * s + 1 (two) */
+double (*pheromone)[L_MAX * 2 + 1][2 * SPECIES_NUM];
+double (*tempPheromone)[L_MAX * 2 + 1][2 * SPECIES_NUM];
+# define FIELD_BYTES (sizeof (*pheromone) * (L_MAX * 2 + 1))
+
+/* max, sum and nonzero cells of each plane as of the end of the last step, */
+/* reduced in the evaporation pass so nothing else has to scan the field */
+typedef struct {
+	double max;
+	double sum;
+	int nonzero;
+} fieldStat;
+
+fieldStat fieldStats[2 * SPECIES_NUM];
 
-/* Pheromone */
-double pheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2];
-double tempPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2];
-double normalizedPheromoneOne[L_MAX * 2 + 1][L_MAX * 2 + 1];
-double normalizedPheromoneTwo[L_MAX * 2 + 1][L_MAX * 2 + 1];
+/* bumped whenever the field changes as a whole, so readers can tell it is new */
+int fieldVersion = 0;
 
-/* NOT USED */
-int obstaclePlace[L_MAX * 2 + 1][L_MAX * 2 + 1];
+/* Pyramid: level 0 blocks are PYRAMID_TILE x PYRAMID_TILE cells and each level */
+/* above merges 2 x 2 blocks, up to a single block; blocks of level l live at */
+/* pyramid[k][pyramidOffset[l] + bx * pyramidSide[l] + by] */
+/* diffusion and evaporation touch every cell that holds pheromone, so the pyramid is */
+/* rebuilt in full when it is read after the field changed, which telemetry does every N steps */
+# define PYRAMID_TILE (4)
+# define PYRAMID_WIDTH ((L_MAX * 2 + PYRAMID_TILE) / PYRAMID_TILE)
+# define PYRAMID_BLOCKS (2 * PYRAMID_WIDTH * PYRAMID_WIDTH + 64)
+# define PYRAMID_LEVEL_MAX (32)
+
+typedef struct {
+	double sum;
+	double max;
+	int cells;
+} pyramidBlock;
+
+pyramidBlock (*pyramid)[PYRAMID_BLOCKS];
+int *pyramidOpen;
+int pyramidLevels = 0;
+int pyramidSide[PYRAMID_LEVEL_MAX];
+int pyramidOffset[PYRAMID_LEVEL_MAX];
+int pyramidVersion = -1;
+
+/* one plane at a time, normalized by its max, for g_hidden */
+double (*normalizedPheromone)[L_MAX * 2 + 1];
+
+/* Obstacles and food */
+/* OBSTACLE_MODE: 0 is none, 1 is random, 2 is loaded from OBSTACLE_FILE (PBM) */
+/* a bitmap side longer than OBSTACLE_BITMAP_MAX pixels is refused */
+# define OBSTACLE_BITMAP_MAX (8192)
+int (*obstaclePlace)[L_MAX * 2 + 1];
 int foodPos[FOOD_NUM * 7][2];
 
+/* bit d is set if the neighbor in direction d is inside and not an obstacle */
+unsigned char (*passableMask)[L_MAX * 2 + 1];
+
+/* hex offset of each direction: 0 is up, and 1 ~ is defined clockwisely */
+const int directionX[6] = {-1, -1, 0, 1, 1, 0};
+const int directionY[6] = {0, 1, 1, 0, -1, -1};
+
 /* statistics */
-int comeBack;
-int totalAnt = 0;
 int procedureCount = 0;
 int ratio[3];
-double homingProb[MAX_PROCEDURE];
-int homingNum[MAX_PROCEDURE];
+double homingProb[COLONY_NUM];
+int homingNum[COLONY_NUM];
 int startingTime;
+
+/* Convergence: a run stops once homing probability and the pheromone total */
+/* have changed less than the tolerances for convergePatience windows in a row */
+# define STOP_MAX_PROCEDURE (0)
+# define STOP_CONVERGED (1)
+
+const char *stopReasonName[2] = {"maxProcedure", "converged"};
+double convergeLastHoming;
+double convergeLastField;
+int convergeStable;
+int stopStep = -1;
+int stopReason = -1;
 double remainingTime;
 
+/* Scenario library: food, nests, obstacles and a starting field for each layout, */
+/* built from text by ./antstrail scenario and mapped read-only once per process, */
+/* so every run of a sweep or a job server reads the same pages */
+/* file: scenarioHeader, count offsets (long long), then the records */
+# define SCENARIO_VERSION (1)
+
+typedef struct {
+	char magic[4];
+	int version;
+	int lMax;
+	int colonyNum;
+	int foodNum;
+	int surroundingMode;
+	int count;
+	int reserved;
+} scenarioHeader;
+
+/* followed by obstacleCount (x, y) pairs of short and cellCount scenarioCell */
+typedef struct {
+	char name[32];
+	int nest[COLONY_NUM][2];
+	int food[FOOD_NUM * 7][2];
+	int obstacleCount;
+	int cellCount;
+	unsigned long long hash;
+} scenarioRecord;
+
+/* starting pheromone of one cell */
+typedef struct {
+	short x;
+	short y;
+	short plane;
+	short reserved;
+	float value;
+} scenarioCell;
+
+const char *scenarioMap = NULL;
+size_t scenarioSize = 0;
+int scenarioCount = 0;
+const scenarioRecord *activeScenario = NULL;
+
+/* Warm start: <run>.field is the final field of a run (SAVE_FIELD or ANTS_SAVE_FIELD=1) */
+/* and its ants; ANTS_WARM=<file> starts every run of the process from it instead of */
+/* an empty field, and ANTS_WARM_ANTS=1 (agent engine only) puts the ants where they were */
+/* file: fieldHeader, pheromone, then antList and count, tempCount of each colony */
+# define FIELD_VERSION (2)
+
+typedef struct {
+	char magic[4];
+	int version;
+	int lMax;
+	int speciesNum;
+	int antNum;
+	int colonyNum;
+	int step;
+	int hasAnts;
+} fieldHeader;
+
+int doesSaveField = SAVE_FIELD;
+int doesWarmAnts = WARM_ANTS;
+const char *warmMap = NULL;
+size_t warmSize = 0;
+unsigned long long warmHash = 0;
+
 /* Ants */
-ant antList[ANT_NUM];
+ant *antList;
+
+/* COLONY SETTING: nest x, nest y, population, lug, species; the rest is set at start */
+/* e.g. two colonies on one field: */
+/* {.nestX = L_MAX, .nestY = L_MAX / 2, .population = ANT_NUM / 2, .lug = LUG * 2, .species = 0}, */
+/* {.nestX = L_MAX, .nestY = L_MAX * 3 / 2, .population = ANT_NUM / 2, .lug = LUG * 2, .species = 0} */
+# define COLONY_DEFAULT { \
+	{.nestX = L_MAX, .nestY = L_MAX, .population = ANT_NUM, .lug = LUG, .species = 0}, \
+}
 
-/* Seed */
+colony colonyList[COLONY_NUM] = COLONY_DEFAULT;
+const colony colonyDefault[COLONY_NUM] = COLONY_DEFAULT;
+
+/* Parameters in use, a branch changes some of them after the warm-up */
+# define PARAMETER_DEFAULT { \
+	THRESHOLD_ONE_SENSITIVE, THRESHOLD_ONE_INSENSITIVE, \
+	THRESHOLD_TWO_SENSITIVE, THRESHOLD_TWO_INSENSITIVE, \
+	PHEROMONE_RELEASE_ONE, PHEROMONE_RELEASE_TWO, \
+	DIFFUSION_COEF_ONE, EVAPORATE_COEF_ONE, \
+	DIFFUSION_COEF_TWO, EVAPORATE_COEF_TWO, \
+	CONVERGE_WINDOW, CONVERGE_TOLERANCE, \
+	CONVERGE_FIELD_TOLERANCE, CONVERGE_PATIENCE, \
+	SCENARIO, \
+}
+
+parameter param = PARAMETER_DEFAULT;
+const parameter parameterDefault = PARAMETER_DEFAULT;
+
+/* Seed, and the name of output files: <seed>, or <seed>-<branch> */
+/* requestedSeed < 0 takes the time */
+int requestedSeed = SET_SEED;
 int seed;
+char runName[32];
+
+/* a name for output files instead of the seed, NULL for the seed */
+const char *runLabel = NULL;
+
+/* Random numbers: xorshift64* so that the whole state can be saved */
+# define RANDOM_MAX (2147483647)
+unsigned long long randomState;
+
+/* 1 turns every number x into RANDOM_MAX - x, the antithetic run of a seed */
+int isAntithetic = 0;
+
+/* Checkpoint: header and then every section of checkpointSections as raw memory */
+/* CHECKPOINT_INTERVAL steps apart into <seed>.ckpt, 0 turns it off */
+# define CHECKPOINT_VERSION (6)
+/* sections of checkpointSections: 21 always and 6 more for the mean field */
+# define CHECKPOINT_SECTION_BASE (21)
+# define CHECKPOINT_SECTION_MEAN_FIELD (6)
+# define CHECKPOINT_SECTION_MAX (CHECKPOINT_SECTION_BASE + CHECKPOINT_SECTION_MEAN_FIELD)
+
+typedef struct {
+	char magic[4];
+	int version;
+	int lMax;
+	int antNum;
+	int colonyNum;
+	int speciesNum;
+	int foodCount;
+	int engine;
+	int seed;
+	int step;
+	int sectionCount;
+	int seriesRows;
+	long long size;
+	long long seriesOffset;
+	unsigned long long randomState;
+} checkpointHeader;
+
+/* Time series: buffered rows go to <seed>.series one block at a time */
+/* each block is the row count and then every column contiguously */
+typedef struct {
+	char magic[4];
+	int version;
+	int seed;
+	int lMax;
+	int antNum;
+	int vitality;
+	int foodNum;
+	int surroundingMode;
+	int maxProcedure;
+	int increment;
+	int colonyNum;
+	int foodCount;
+	int columnCount;
+
+	/* SERIES_BUFFER of the build that wrote it, the most rows a block holds */
+	int blockRows;
+	int engine;
+	double lug;
+	double thresholdOneSensitive;
+	double thresholdOneInsensitive;
+	double thresholdTwoSensitive;
+	double thresholdTwoInsensitive;
+	double pheromoneReleaseOne;
+	double pheromoneReleaseTwo;
+	double diffusionCoefOne;
+	double evaporateCoefOne;
+	double diffusionCoefTwo;
+	double evaporateCoefTwo;
+
+	/* -1 until the run ends */
+	int stopStep;
+	int stopReason;
+} seriesHeader;
+
+/* followed by foodPos[foodCount][2] and columnCount names of 16 bytes */
+# define SERIES_VERSION (3)
+/* column 0 is the step, then homingProb, homingNum and totalAnt of each colony */
+# define SERIES_COLUMN (1 + 3 * COLONY_NUM)
+
+FILE *seriesFile = NULL;
+char seriesFileName[48];
+int seriesRows = 0;
+int seriesStep[SERIES_BUFFER];
+double seriesHomingProb[COLONY_NUM][SERIES_BUFFER];
+int seriesHomingNum[COLONY_NUM][SERIES_BUFFER];
+int seriesTotalAnt[COLONY_NUM][SERIES_BUFFER];
+
+/* 0 runs without any window (benchmarks, batch runs) */
+int doesDraw = DRAW;
+
+/* 1 keeps progress messages off stdout */
+int isQuiet = 0;
+
+/* Rendering runs on its own thread and owns every g_ call while a run goes on */
+/* the simulation fills renderBack every RENDER_INTERVAL steps and swaps it */
+/* with renderFront; a snapshot not picked up before the next one is dropped */
+typedef struct {
+	int step;
+	int ratio[3];
+	double homing;
+	unsigned char isOut[ANT_NUM];
+	unsigned char mode[ANT_NUM];
+	short x[ANT_NUM];
+	short y[ANT_NUM];
+} renderSnapshot;
+
+renderSnapshot renderBuffer[2];
+renderSnapshot *renderBack = &renderBuffer[0];
+renderSnapshot *renderFront = &renderBuffer[1];
+renderSnapshot renderFrame;
+int renderFresh = 0;
+int renderStop = 0;
+int renderHasField = 0;
+int renderPublished = 0;
+int renderDrawn = 0;
+/* set once the last frame and the field are drawn, before the window waits */
+int renderFinished = 0;
+int isRendering = 0;
+pthread_t renderThread;
+pthread_mutex_t renderLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t renderCond = PTHREAD_COND_INITIALIZER;
+
+/* The ant view is rasterized into frameColor, FRAME_SCALE pixels per unit, */
+/* over frameBase (obstacles and food), and only pixels that differ from */
+/* framePresented reach the window, as one box per run of equal color */
+# define FRAME_SIZE ((L_MAX * 22 * FRAME_SCALE + 9) / 10 + 1)
+
+int framePixel[L_MAX * 2 + 1][L_MAX * 2 + 1];
+unsigned char frameBase[FRAME_SIZE * FRAME_SIZE];
+unsigned char frameColor[FRAME_SIZE * FRAME_SIZE];
+unsigned char framePresented[FRAME_SIZE * FRAME_SIZE];
+
+/* 0 leaves no series, csv or checkpoint behind (sweep jobs) */
+int doesWrite = 1;
+
+/* Profile: nanoseconds per phase and event counts */
+/* turned on by PROFILE or by the ANTS_PROFILE environment variable */
+/* phases are exclusive: a phase timed inside another one is taken out of it, */
+/* so ant is the ant update less its sensing, direction, deposition and plotting, */
+/* and the phases add up to the time of a step; the ant update is timed on one step */
+/* in PROFILE_SAMPLE (a divisor of PROFILE_INTERVAL) and counted for all of them, */
+/* which keeps the clock calls of every ant from swamping what they measure; */
+/* normalization is timed on the render thread, which alone adds to it */
+# define PHASE_ANT (0)
+# define PHASE_SENSING (1)
+# define PHASE_DIRECTION (2)
+# define PHASE_DEPOSITION (3)
+# define PHASE_DIFFUSION (4)
+# define PHASE_EVAPORATION (5)
+# define PHASE_NORMALIZATION (6)
+# define PHASE_RENDERING (7)
+# define PHASE_NUM (8)
+
+# define EVENT_MODE_CHANGE (0)
+# define EVENT_FOOD (1)
+# define EVENT_RETURN (2)
+# define EVENT_WALL (3)
+# define EVENT_NUM (4)
+
+const char *phaseName[PHASE_NUM] = {"ant", "sensing", "direction", "deposition", "diffusion", "evaporation", "normalization", "rendering"};
+const char *eventName[EVENT_NUM] = {"modeChange", "food", "return", "wall"};
+
+int doesProfile = PROFILE;
+long long phaseTime[PHASE_NUM];
+long long eventCount[EVENT_NUM];
+long long lastPhaseTime[PHASE_NUM];
+long long lastEventCount[EVENT_NUM];
+int lastProfileStep = 0;
+int profileSteps = 0;
+FILE *profileFile = NULL;
+
+/* open phases of this thread, with the time spent in phases opened inside each */
+# define PROFILE_DEPTH (8)
+__thread int profileDepth = 0;
+__thread long long profileInner[PROFILE_DEPTH];
+__thread int profileTiming = 1;
+__thread int profileScale = 1;
+
+/* World arena: the grids and the ants are carved out of one mapping, once per */
+/* process, and every later run (sweep, job worker, library) reuses it as is */
+/* ARENA_PAGES: 0 is small pages, 1 transparent huge pages, 2 reserved huge pages */
+# define ARENA_HUGE_PAGE (2 << 20)
+
+typedef struct {
+	char *base;
+	size_t size;
+	size_t used;
+	int blocks;
+	/* what was actually obtained, may be less than asked for */
+	int pages;
+	int runs;
+	long faults;
+} arena;
+
+arena worldArena = {NULL, 0, 0, 0, 0, 0, 0};
+const char *arenaPageName[3] = {"small", "transparent huge", "reserved huge"};
+
+/* Mean field (ENGINE 1): number of ants per cell by mode and direction */
+/* MEAN_FIELD_MODE 0 moves the expectation, 1 samples a multinomial split */
+/* mode 3 carries food, ants whose vitality runs out go back to the nest at once */
+double (*density)[L_MAX * 2 + 1][L_MAX * 2 + 1][3][6];
+double (*nextDensity)[L_MAX * 2 + 1][L_MAX * 2 + 1][3][6];
+unsigned char (*foodPlace)[L_MAX * 2 + 1];
+double meanFieldComeBack[COLONY_NUM];
+double meanFieldTotal[COLONY_NUM];
+double meanFieldRespawn[COLONY_NUM];
+/* ants' worth of each event not yet added to eventCount */
+double meanFieldEvent[EVENT_NUM];
+
+/* Trajectory: <run>.traj, the world once and then one block per step */
+/* block: step, a 4-bit code per ant, mode changes and spawns */
+/* code 0 ~ 5 moved that way, 6 stayed, 7 not out of the nest yet */
+/* spawned ants start at their nest with mode 1, before moving */
+# define TRAJECTORY_VERSION (1)
+# define TRAJECTORY_STAYED (6)
+# define TRAJECTORY_INSIDE (7)
+
+typedef struct {
+	char magic[4];
+	int version;
+	int seed;
+	int lMax;
+	int antNum;
+	int colonyNum;
+	int maxProcedure;
+	int foodCount;
+} trajectoryHeader;
+
+/* followed by nestX, nestY, first, population of each colony, */
+/* foodPos[foodCount][2] and obstaclePlace as one byte per cell */
+
+/* turned on by TRAJECTORY or by the ANTS_TRAJECTORY environment variable */
+int doesTrajectory = TRAJECTORY;
+FILE *trajectoryFile = NULL;
+int trajectoryX[ANT_NUM];
+int trajectoryY[ANT_NUM];
+int trajectoryMode[ANT_NUM];
+unsigned char trajectoryOut[ANT_NUM];
+unsigned char trajectorySpawned[ANT_NUM];
+unsigned char trajectoryBlock[3 * sizeof (int) + ANT_NUM / 2 + 1 + ANT_NUM * 3 * sizeof (int)];
+
+/* double buffer: the simulation fills one while the writer thread writes the other */
+unsigned char trajectoryBuffer[2][TRAJECTORY_BUFFER];
+int trajectoryFill = 0;
+int trajectoryCurrent = 0;
+int trajectoryPending = -1;
+int trajectoryPendingSize = 0;
+int trajectoryStop = 0;
+pthread_t trajectoryThread;
+pthread_mutex_t trajectoryLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t trajectoryCond = PTHREAD_COND_INITIALIZER;
+
+/* Heatmaps: every heatmapInterval steps the pheromone planes are copied into */
+/* a free slot and a pool of workers writes them as <run>.heat/<step>.ppm, */
+/* one panel per plane; with every slot busy the snapshot is dropped */
+/* each cell is a 2 x 2 block, odd columns half a cell lower, as on the hex field */
+# define HEATMAP_FREE (0)
+# define HEATMAP_FILLING (1)
+# define HEATMAP_QUEUED (2)
+# define HEATMAP_ENCODING (3)
+# define HEATMAP_PANEL_WIDTH (2 * (L_MAX * 2 + 1))
+# define HEATMAP_HEIGHT (4 * L_MAX + 2)
+# define HEATMAP_WIDTH (2 * SPECIES_NUM * (HEATMAP_PANEL_WIDTH + 2) - 2)
 
+typedef struct {
+	int state;
+	int step;
+	double max[2 * SPECIES_NUM];
+	float field[2 * SPECIES_NUM][L_MAX * 2 + 1][L_MAX * 2 + 1];
+} heatmapSlot;
+
+/* turned on by HEATMAP_INTERVAL or by the ANTS_HEATMAP environment variable */
+int heatmapInterval = HEATMAP_INTERVAL;
+/* number of running workers, 0 while not exporting */
+int isExporting = 0;
+int heatmapStop = 0;
+int heatmapWritten = 0;
+int heatmapDropped = 0;
+char heatmapDir[48];
+heatmapSlot heatmapSlots[HEATMAP_QUEUE];
+pthread_t heatmapThread[HEATMAP_WORKERS];
+pthread_mutex_t heatmapLock = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t heatmapCond = PTHREAD_COND_INITIALIZER;
+
+/* Telemetry: a POSIX shared memory segment /antstrail.<run> holding a ring of */
+/* per step records and the latest field thumbnails, for ./antstrail monitor */
+/* one writer, any number of readers: a slot is valid while its seq equals */
+/* the record number before and after copying it, thumbnails use a seqlock */
+# define TELEMETRY_VERSION (1)
+
+typedef struct {
+	long long seq;
+	int step;
+	int ratio[3];
+	int comeBack[COLONY_NUM];
+	int totalAnt[COLONY_NUM];
+	double stepsPerSec;
+	/* cumulative, zero unless profiling */
+	long long phaseNs[PHASE_NUM];
+} telemetryRecord;
+
+typedef struct {
+	char magic[4];
+	int version;
+	int pid;
+	int colonyNum;
+	int ring;
+	int thumbnailSide;
+	int isFinished;
+	long long head;
+	long long thumbnailSeq;
+	int thumbnailStep;
+	float thumbnail[2][TELEMETRY_THUMBNAIL * TELEMETRY_THUMBNAIL];
+	telemetryRecord records[TELEMETRY_RING];
+} telemetrySegment;
+
+/* turned on by TELEMETRY or by the ANTS_TELEMETRY environment variable */
+int doesTelemetry = TELEMETRY;
+telemetrySegment *telemetry = NULL;
+char telemetryName[64];
+long long telemetryLastClock;
+int telemetryLastStep;
+double telemetrySpeed;
+
+/* Job server: ./antstrail serve forks JOB_WORKERS workers (0 is one per core) */
+/* that each keep one world and run queued jobs in it, one after another; */
+/* jobs arrive as text lines on a Unix socket and live in a shared table */
+# define JOB_FREE (-1)
+# define JOB_QUEUED (0)
+# define JOB_RUNNING (1)
+# define JOB_DONE (2)
+# define JOB_FAILED (3)
+# define JOB_SINK_CSV (1)
+# define JOB_SINK_TRAJECTORY (2)
+# define JOB_SINK_HEATMAP (4)
+# define JOB_SINK_FIELD (8)
+
+typedef struct {
+	int state;
+	/* ids keep growing; job id lives in slot id % JOB_MAX */
+	int id;
+	int seed;
+	int sinks;
+	int worker;
+	/* last finished step while running */
+	int step;
+	int stopStep;
+	int stopReason;
+	int isCached;
+	int comeBack[COLONY_NUM];
+	int totalAnt[COLONY_NUM];
+	double homing;
+	double seconds;
+	char delta[256];
+	char runName[32];
+} job;
+
+const char *jobStateName[4] = {"queued", "running", "done", "failed"};
+job *jobList = NULL;
+int *jobCount = NULL;
+int *jobStop = NULL;
+int *jobProgress = NULL;
+
+/* Library (antstrail.h): steps run in the world antsCreate made */
+int libraryStep = 0;
+
+/* Result cache: CACHE_DIR/<key>.result (and .series) of finished runs */
+/* the key is a hash of everything a run depends on, see cacheKeyFill */
+/* bump ENGINE_VERSION when a change alters results, so old entries are not used */
+# define ENGINE_VERSION (2)
+# define CACHE_VERSION (3)
+
+typedef struct {
+	int engineVersion;
+	int lMax;
+	int antNum;
+	int vitality;
+	int foodNum;
+	int surroundingMode;
+	int obstacleNum;
+	int obstacleSurrounding;
+	int obstacleMode;
+	int maxProcedure;
+	int increment;
+	int colonyNum;
+	int speciesNum;
+	int engine;
+	int meanFieldMode;
+	int ensembleInterval;
+	int seed;
+	int isAntithetic;
+	int colonySetting[COLONY_NUM][4];
+	double colonyLug[COLONY_NUM];
+	unsigned long long obstacleFileHash;
+	unsigned long long scenarioHash;
+	unsigned long long warmHash;
+	int warmAnts;
+	parameter param;
+} cacheKey;
+
+typedef struct {
+	char magic[4];
+	int version;
+	cacheKey key;
+	int stopStep;
+	int stopReason;
+	int comeBack[COLONY_NUM];
+	int totalAnt[COLONY_NUM];
+	int tracePoints;
+} cacheRecord;
+
+/* 0 for runs that do not start from their seed alone (branches, resumes) */
+int isCacheable = CACHE;
+
+/* Sweep: every set runs replicates in rounds of sweepSeeds */
+/* until the CI of its final homing probability is narrower than sweepCiWidth */
+/* result k is set k / sweepMaxSeeds, replicate k % sweepMaxSeeds */
+typedef struct {
+	int status;
+	int seed;
+	int isAntithetic;
+	double seconds;
+	double homing;
+	int stopStep;
+	int stopReason;
+	int isCached;
+	int comeBack[COLONY_NUM];
+	int totalAnt[COLONY_NUM];
+} sweepResult;
+
+/* Welford: count, mean and sum of squared differences from the mean */
+typedef struct {
+	long long n;
+	double mean;
+	double m2;
+} ensembleStat;
+
+# define ENSEMBLE_POINTS (MAX_PROCEDURE / ENSEMBLE_INTERVAL + 1)
+
+parameter *sweepSet = NULL;
+int sweepSetNum = 0;
+int sweepSeeds = 1;
+int sweepMaxSeeds = 0;
+int sweepFirstSeed = 1;
+double sweepCiWidth = 0;
+
+/* crn 1 gives every set the same seeds (common random numbers) */
+/* antithetic 1 pairs each seed with its antithetic run */
+int sweepCrn = 1;
+int sweepAntithetic = 0;
+
+/* jobs of this round, as result indices */
+int *sweepJobList = NULL;
+int sweepJobNum = 0;
+
+/* shared with the workers: each one owns a range of jobs, (head << 32) | tail */
+/* the owner takes from the head and idle workers steal from the tail */
+unsigned long long *sweepRange = NULL;
+sweepResult *sweepResultList = NULL;
+
+/* homing probability every ENSEMBLE_INTERVAL steps, per set, under a lock per set */
+ensembleStat *sweepStat = NULL;
+int *sweepLock = NULL;
+double *ensembleTrace = NULL;
 
 /*
  *
@@ -179,27 +959,49 @@ void graphicInitialization ();
 void instructionInitialization ();
 void boxExplanation ();
 void pheromoneInitialization ();
+void colonyInitialization ();
 void antInitialization();
 void initializeGivenAnt (int a_n);
+int isNest (int x, int y);
+int totalComeBack ();
+int totalAntCount ();
 void foodInitialization ();
+void placeFood (int f, int x, int y);
+void obstacleInitialization ();
+void placeObstacle (int x, int y);
+int loadObstacleBitmap (const char *fileName);
+void passableMaskInitialization ();
+int isOpenCell (int x, int y);
 void backgroundInitialization ();
 void calculateRemaningTime ();
 void drawAllFood ();
+void drawAllObstacles ();
 void drawNest ();
 void halt();
 
 /* Graphic */
-void progressBar ();
-void ratioBar ();
-void homingBar ();
-void normalizePheromone ();
+void progressBar (const renderSnapshot *s);
+void ratioBar (const renderSnapshot *s);
+void homingBar (const renderSnapshot *s);
+void normalizePheromone (int k);
 void drawPheromoneDistribution ();
+void renderStart ();
+void renderPublish (int t);
+void renderFinal ();
+void renderSettle ();
+void renderClose ();
+void *renderLoop (void *arg);
+void renderDraw (const renderSnapshot *s);
+void frameInitialization ();
+void framePresent ();
 
 /* Ant behavior */
 void singleAntMovement (int a_n);
 void singleMovement (int a_n);
 void multipleMovement ();
-void consecutiveMovement ();
+void consecutiveMovement (int t, int end);
+void consecutiveStep (int t);
+void finishProcedure (int t);
 void movementOne (int a_n);
 void movementTwo (int a_n);
 void movementThree (int a_n);
@@ -207,21 +1009,194 @@ int hasDiscoveredFood (int a_n);
 int hasGoneBack (int a_n);
 int calculateDirection (int mode, int dir, int a_n);
 int calculateProb (int tempPheromone[6], int dir);
+void calculateWeight (int tempPheromone[6], int surrounding[6]);
+void surroundingPheromoneAt (int x, int y, int plane, int surroundingPheromone[6]);
 void moveToGivenDirection (int dir, int a_n);
 void plotAnt (int a_n, int color);
+void plotCell (int x, int y, int color);
+int antIsOut (int a_n);
 int checkPheromone (int a_n, int pheromone_num);
 
+/* Mean field */
+void meanFieldInitialization ();
+void meanFieldMovement (int t, int end);
+void meanFieldStep ();
+void meanFieldEvents ();
+void meanFieldArrive (int c, int x, int y, int m, int d, double mass);
+void meanFieldSpread (int c, int x, int y, double mass);
+double meanFieldSample (double mass, double p);
+double binomialSample (double n, double p);
+void meanFieldRatio ();
+
+/* Convergence */
+int convergeCheck (int t);
+double pheromoneTotal ();
+
 /* Pheromone Behavior */
 void pheromoneBehavior ();
 void pheromoneDiffusion ();
 void pheormoneEvaporation ();
+void fieldStatUpdate ();
+
+/* Pyramid */
+void pyramidInitialization ();
+void pyramidRefresh ();
+int pyramidLevelFor (int side);
+void pyramidRegion (int k, int x0, int y0, int x1, int y1, pyramidBlock *out);
+void pyramidRegionAt (int k, int level, int bx, int by, int x0, int y0, int x1, int y1, pyramidBlock *out);
+void pyramidThumbnail (int k, int side, float *out);
+
+/* Profile */
+void profileInitialization ();
+long long profileClock ();
+long long profileBegin ();
+void profileEnd (int phase, long long start);
+void profileSample (int t);
+void profileSampleEnd ();
+void profileStep (int t);
+void profileSummary ();
 
 /* File output */
 void createAndWriteInFile ();
+void seriesInitialization ();
+void seriesWriteHeader (FILE *fp);
+void seriesBranch (const char *parentName);
+void seriesRecord (int t);
+void seriesFlush ();
+void seriesClose ();
+int seriesExportCsv (const char *seriesName, const char *csvName);
+
+/* Trajectory */
+void trajectoryInitialization ();
+void trajectoryRecord (int t);
+void trajectoryWrite (const void *data, int size);
+void trajectorySwap ();
+void *trajectoryWriter (void *arg);
+void trajectoryClose ();
+int trajectoryReplay (const char *fileName, const char *csvName);
+
+/* Heatmap */
+void heatmapInitialization ();
+void heatmapCapture (int t);
+void *heatmapWorker (void *arg);
+int heatmapWrite (heatmapSlot *slot, unsigned char *image);
+void heatmapColor (double v, unsigned char *rgb);
+void heatmapClose ();
+
+/* Telemetry */
+void telemetryInitialization ();
+void telemetryPublish (int t);
+void telemetryClose ();
+int telemetryMonitor (const char *run, int isCsv);
+void modeRatio ();
+
+/* Scenario library */
+int scenarioOpen (const char *fileName);
+const scenarioRecord *scenarioFind (int id);
+void scenarioInitialization ();
+int scenarioBuild (const char *libraryName, int count, char *sourceName[]);
+int scenarioIsObstacle (const short *obstacle, int total, int x, int y);
+int scenarioValid (const scenarioRecord *r);
+int scenarioCheck (const scenarioRecord *record, const short *obstacle, int total);
+int scenarioList (const char *libraryName);
+const char *scenarioLibraryName ();
+
+/* Warm start */
+const char *warmFileName ();
+int warmOpen (const char *fileName);
+void warmField ();
+void warmAnts ();
+void warmSaveInitialization ();
+void warmSave ();
+
+/* World arena */
+void arenaInitialization ();
+void *arenaTake (size_t bytes);
+void arenaRunStart ();
+long arenaFaults ();
+long arenaHugeBytes ();
+void arenaSummary ();
+
+/* Job server */
+int jobServe (int workers);
+void jobWorker (int w);
+void jobRun (int k);
+void jobAnswer (int fd, char *line);
+void jobDescribe (int fd, int k);
+int jobParseSinks (const char *text);
+const char *jobSocketPath ();
+int jobRequest (const char *line, int doesWait);
+
+/* Random numbers */
+void randomSeed (unsigned long long s);
+int randomNext ();
+int randomBelow (int k);
+
+/* Checkpoint */
+int checkpointSections (void *section[], size_t size[], int capacity);
+void checkpointWrite (int step);
+int checkpointResume (const char *fileName);
+
+/* Branch */
+double *parameterField (const char *name);
+int parameterApply (const char *delta);
+int branchRun (int steps, int count, char *delta[]);
+void branchChild (int b, const char *delta, int steps);
+
+/* Sweep */
+int sweepRun (const char *specName, const char *csvName, int workers);
+int sweepParse (const char *specName);
+int sweepExpand (char *line, const parameter *base);
+int sweepSchedule (int workers);
+int sweepTake (int w, int workers);
+void sweepWorker (int w, int workers);
+void sweepJob (int k);
+int sweepSeedOf (int set, int replicate);
+int sweepWrite (const char *csvName);
+void ensembleAdd (ensembleStat *stat, double x);
+double ensembleDeviation (const ensembleStat *stat);
+double ensembleHalfWidth (const ensembleStat *stat);
+void ensembleFinal (int set, int done, ensembleStat *stat);
+int ensembleWrite (const char *csvName, int done[]);
+void ensembleTraceFinish ();
+
+/* Cache */
+int cacheEnabled ();
+int cacheCoversOutput ();
+unsigned long long cacheHash (const void *data, size_t size, unsigned long long h);
+void cacheKeyFill (cacheKey *key, int keySeed);
+void cachePath (const cacheKey *key, const char *extension, char *path);
+int cacheLoad (const cacheKey *key, cacheRecord *record, double trace[]);
+void cacheRestore (const cacheRecord *record);
+void cacheStore (const cacheKey *key, const double trace[], const char *seriesName);
+int cacheCopy (const char *from, const char *to);
+
+/* Benchmark */
+void benchmark (const char *fileName);
+void benchmarkReport (FILE *fp, const char *kernel, long long calls, double seconds, double cells, double antSteps, double bytes);
+double benchmarkSeconds (long long start);
 
 /* Test */
 void graphicTest ();
 void structAntTest (int a_n);
+int differentialTest ();
+void randomizeWorld ();
+int testResult (const char *name, int trial, int isOk);
+int testMove ();
+int testSurrounding ();
+int testCheckPheromone ();
+int testDiffusion ();
+int testEvaporation ();
+int testPyramid ();
+int testDirectionDistribution ();
+int referenceOpen (int x, int y);
+void referenceMove (int dir, int a_n);
+void referenceSurrounding (int a_n, int plane, int surroundingPheromone[6]);
+int referenceCheckPheromone (int a_n, int pheromone_num);
+void referenceDirection (int a_n, int mode, int plane, double probability[6]);
+int testEngineAgreement ();
+void referenceDiffusion ();
+void referenceEvaporation ();
 
 /*
  *
@@ -230,47 +1205,202 @@ void structAntTest (int a_n);
  */
 
 
-/* Main */
-int main () {
-	initialization();
+/* Main, left out when built as a library (see antstrail.h) */
+# ifndef ANTSTRAIL_LIBRARY
+int main (int argc, char *argv[]) {
+	int c;
+	int t = 0;
+	int isCached = 0;
+	double trace[ENSEMBLE_POINTS];
+	char path[256];
+	cacheKey key;
+	cacheRecord record;
+
+	arenaInitialization ();
+
+	/* ./antstrail scenario <library> [source ...] builds a scenario library, or lists one */
+	if (argc > 2 && strcmp (argv[1], "scenario") == 0) {
+		if (argc == 3) {
+			return scenarioList (argv[2]) ? 0 : 1;
+		}
+		return scenarioBuild (argv[2], argc - 3, argv + 3) ? 0 : 1;
+	}
+
+	/* mapped before any fork, so sweep and job workers share its pages */
+	scenarioOpen (scenarioLibraryName ());
+	if (warmFileName () != NULL && warmOpen (warmFileName ()) == 0) {
+		return 1;
+	}
+
+	/* ./antstrail bench [file] writes kernel timings and exits */
+	if (argc > 1 && strcmp (argv[1], "bench") == 0) {
+		benchmark (argc > 2 ? argv[2] : "bench.jsonl");
+		return 0;
+	}
+
+	/* ./antstrail csv <series> [csv] exports a time series */
+	if (argc > 2 && strcmp (argv[1], "csv") == 0) {
+		return seriesExportCsv (argv[2], argc > 3 ? argv[3] : "series.csv") ? 0 : 1;
+	}
+
+	/* ./antstrail test compares kernels against the reference ones */
+	if (argc > 1 && strcmp (argv[1], "test") == 0) {
+		return differentialTest () == 0 ? 0 : 1;
+	}
+
+	/* ./antstrail branch <steps> <delta> ... forks runs after a shared warm-up */
+	if (argc > 3 && strcmp (argv[1], "branch") == 0) {
+		return branchRun (atoi (argv[2]), argc - 3, argv + 3) == 0 ? 0 : 1;
+	}
+
+	/* ./antstrail sweep <spec> [csv] [workers] runs every set and seed on all cores */
+	if (argc > 2 && strcmp (argv[1], "sweep") == 0) {
+		return sweepRun (argv[2], argc > 3 ? argv[3] : "sweep.csv", argc > 4 ? atoi (argv[4]) : 0) == 0 ? 0 : 1;
+	}
+
+	/* ./antstrail monitor <run> [csv] follows a run started with ANTS_TELEMETRY=1 */
+	if (argc > 2 && strcmp (argv[1], "monitor") == 0) {
+		return telemetryMonitor (argv[2], argc > 3 && strcmp (argv[3], "csv") == 0) ? 0 : 1;
+	}
+
+	/* ./antstrail serve [workers] runs jobs sent to the socket in ANTS_SOCKET (or JOB_SOCKET) */
+	if (argc > 1 && strcmp (argv[1], "serve") == 0) {
+		return jobServe (argc > 2 ? atoi (argv[2]) : JOB_WORKERS);
+	}
+
+	/* ./antstrail submit <seed> <delta> [csv,traj,heat] queues a job and prints its id */
+	if (argc > 3 && strcmp (argv[1], "submit") == 0) {
+		if (snprintf (path, sizeof (path), "submit %d %s %s", atoi (argv[2]), argv[3], argc > 4 ? argv[4] : "csv") >= (int) sizeof (path)) {
+			printf ("REQUEST IS TOO LONG\n");
+			return 1;
+		}
+		return jobRequest (path, 0) ? 0 : 1;
+	}
+
+	/* ./antstrail status [id], ./antstrail wait <id> and ./antstrail shutdown talk to the server */
+	if (argc > 1 && (strcmp (argv[1], "status") == 0 || strcmp (argv[1], "wait") == 0 || strcmp (argv[1], "shutdown") == 0)) {
+		if (snprintf (path, sizeof (path), "%s %s", strcmp (argv[1], "wait") == 0 ? "status" : argv[1], argc > 2 ? argv[2] : "") >= (int) sizeof (path)) {
+			printf ("REQUEST IS TOO LONG\n");
+			return 1;
+		}
+		return jobRequest (path, strcmp (argv[1], "wait") == 0) ? 0 : 1;
+	}
+
+	/* ./antstrail replay <traj> [csv] redraws a recorded run and counts visits */
+	if (argc > 2 && strcmp (argv[1], "replay") == 0) {
+		return trajectoryReplay (argv[2], argc > 3 ? argv[3] : "visits.csv") ? 0 : 1;
+	}
+
+	/* ./antstrail resume <checkpoint> goes on from a saved step */
+	if (argc > 2 && strcmp (argv[1], "resume") == 0) {
+		if ((t = checkpointResume (argv[2])) < 0) {
+			return 1;
+		}
+		isCacheable = 0;
+	}
+	else {
+		initialization();
+
+		if (ENGINE == 1) {
+			meanFieldInitialization ();
+		}
+		ensembleTrace = trace;
+
+		/* a run without window takes a finished identical run from the cache */
+		cacheKeyFill (&key, seed);
+		cachePath (&key, ".series", path);
+		if (doesDraw == 0 && cacheEnabled () && cacheCoversOutput () && access (path, R_OK) == 0 && cacheLoad (&key, &record, trace)) {
+			if (seriesFile != NULL) {
+				fclose (seriesFile);
+				seriesFile = NULL;
+			}
+			isCached = cacheCopy (path, seriesFileName);
+		}
+	}
 
-	consecutiveMovement();
+	if (isCached) {
+		cacheRestore (&record);
+		if (isQuiet == 0) {
+			printf ("FROM CACHE %s\n", path);
+		}
+	}
+	else if (ENGINE == 1) {
+		meanFieldMovement (t, MAX_PROCEDURE);
+	}
+	else {
+		consecutiveMovement (t, MAX_PROCEDURE);
+	}
 	//multipleMovement();
 	//singleAntMovement(0);
 
-	printf ("%d / %d\n", comeBack, totalAnt);
+	for (c = 0; c < COLONY_NUM; c++) {
+		printf ("%d / %d\n", colonyList[c].comeBack, colonyList[c].totalAnt);
+	}
 
-	drawPheromoneDistribution ();
+	if (doesDraw) {
+		renderFinal ();
+	}
 	halt();
 
+	if (isCached == 0 && cacheEnabled () && stopStep >= 0) {
+		ensembleTraceFinish ();
+		cacheStore (&key, trace, doesWrite ? seriesFileName : NULL);
+	}
+
 	return 0;
 }
+# endif
 
 /* -------------------- INITIALIZATION AND HALT ------------------------------ */
 
 /* Called in the beginning */
 void initialization () {
-	if (SET_SEED >= 0) {
-		seed = SET_SEED;
+	if (requestedSeed >= 0) {
+		seed = requestedSeed;
 	}
 	else {
 		seed = (unsigned) time(NULL);
 	}
+	if (runLabel != NULL) {
+		snprintf (runName, sizeof (runName), "%s", runLabel);
+	}
+	else {
+		sprintf (runName, "%d", seed);
+	}
 
 	startingTime = (unsigned) time (NULL);
 	
-	srand(seed);
+	randomSeed (seed);
+
+	convergeStable = 0;
+	stopStep = -1;
+	stopReason = -1;
 
+	arenaRunStart();
+	scenarioInitialization();
+	profileInitialization();
 	honeyCombInitialization();
+	colonyInitialization();
+	obstacleInitialization();
+	passableMaskInitialization();
 	pheromoneInitialization();
 	foodInitialization();
 	antInitialization();
-	graphicInitialization();
-	backgroundInitialization();
-	instructionInitialization();
-	boxExplanation ();
+	if (warmMap != NULL && doesWarmAnts) {
+		warmAnts();
+	}
+	seriesInitialization();
+	trajectoryInitialization();
+	heatmapInitialization();
+	telemetryInitialization();
+	warmSaveInitialization();
+
+	if (doesDraw) {
+		renderStart ();
+	}
 }
 
+# ifndef ANTSTRAIL_LIBRARY
 /* Graphic initializer */
 void graphicInitialization () {
 	g_init("GRAPH", 300.0, 120.0);
@@ -346,13 +1476,13 @@ void instructionInitialization () {
 	char t[16] = "Threshold";
 	char pherRel[20] = "Pheromone release";
 
-	sprintf (secondLine, "%s (Sensitive: %3.1lf, Insensitive %3.1lf), %s (One: %3.1lf, Two: %3.1lf)", t, THRESHOLD_TWO_SENSITIVE, THRESHOLD_TWO_INSENSITIVE, pherRel, PHEROMONE_RELEASE_ONE, PHEROMONE_RELEASE_TWO);
+	sprintf (secondLine, "%s (Sensitive: %3.1lf, Insensitive %3.1lf), %s (One: %3.1lf, Two: %3.1lf)", t, param.thresholdTwoSensitive, param.thresholdTwoInsensitive, pherRel, param.pheromoneReleaseOne, param.pheromoneReleaseTwo);
 
 	/* third line */
 	char diff[16] = "Diffusion";
 	char evap[16] = "Evaporation";
 
-	sprintf (thirdLine, "%s (One: %lf, Two: %lf), %s (One: %lf, Two: %lf)", diff, DIFFUSION_COEF_ONE, DIFFUSION_COEF_TWO, evap, EVAPORATE_COEF_ONE, EVAPORATE_COEF_TWO);
+	sprintf (thirdLine, "%s (One: %lf, Two: %lf), %s (One: %lf, Two: %lf)", diff, param.diffusionCoefOne, param.diffusionCoefTwo, evap, param.evaporateCoefOne, param.evaporateCoefTwo);
 
 	g_text_font (1);
 	g_text_color (7);
@@ -405,6 +1535,7 @@ void boxExplanation () {
 	g_text (214.5, 17, "PHEROMONE 2");
 	g_text (214.5, 20, "DISTRIBUTION");
 }
+# endif
 
 /* Initialize honey comb: Maps Hex to xy coordinate */
 void honeyCombInitialization () {
@@ -471,52 +1602,96 @@ void honeyCombInitialization () {
 
 /* Initialize pheromone distribution */
 void pheromoneInitialization () {
-	int i, j;
+	int i, j, k;
 
 	for (i = 0; i < L_MAX * 2 + 1; i++) {
 		for (j = 0; j < L_MAX * 2 + 1; j++) {
-			if (coordinate[i][j][0] <= L_MAX) {
-				pheromone[i][j][0] = 0;
-				pheromone[i][j][1] = 0;
+			for (k = 0; k < 2 * SPECIES_NUM; k++) {
+				if (isOpenCell(i, j) == 1) {
+					pheromone[i][j][k] = 0;
+					tempPheromone[i][j][k] = 0;
+				} 
+				else {
+					/* outside and obstacles never hold pheromone */
+					pheromone[i][j][k] = -1000;
+					tempPheromone[i][j][k] = -1000;
+				}
+			}
+		}
+	}
 
-				tempPheromone[i][j][0] = 0;
-				tempPheromone[i][j][1] = 0;
-			} 
-			else {
-				pheromone[i][j][0] = -1000;
-				pheromone[i][j][0] = -1000;
+	if (activeScenario != NULL) {
+		const scenarioCell *cell = (const scenarioCell *) ((const short *) (activeScenario + 1) + 2 * activeScenario->obstacleCount);
 
-				tempPheromone[i][j][0] = -1000;
-				tempPheromone[i][j][1] = -1000;
+		for (k = 0; k < activeScenario->cellCount; k++) {
+			if (isOpenCell (cell[k].x, cell[k].y) == 1 && cell[k].plane < 2 * SPECIES_NUM) {
+				pheromone[cell[k].x][cell[k].y][cell[k].plane] = cell[k].value;
 			}
 		}
 	}
+	if (warmMap != NULL) {
+		warmField ();
+	}
+	fieldStatUpdate ();
 }
 
 
-/* Initialize ants structs */
-void antInitialization () {
-	int a_n;
-	int r = rand () % 2;
-	for (a_n = 0; a_n < ANT_NUM; a_n++) {
-		antList[a_n].x = L_MAX;
-		antList[a_n].y = L_MAX;
-		antList[a_n].direction = rand() % 6;
-		antList[a_n].mode = 1;
-		antList[a_n].vitality = N;
-		antList[a_n].hasFood = 0;
-		antList[a_n].hasComeBack = 0;
+/* Lays colonies out in antList */
+void colonyInitialization () {
+	int c;
+	int first = 0;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		colonyList[c].nestX = activeScenario != NULL ? activeScenario->nest[c][0] : colonyDefault[c].nestX;
+		colonyList[c].nestY = activeScenario != NULL ? activeScenario->nest[c][1] : colonyDefault[c].nestY;
 
-		r = rand () % 2;
-		if (r == 0) {
-			antList[a_n].threshold[0] = THRESHOLD_ONE_SENSITIVE;
-			antList[a_n].threshold[1] = THRESHOLD_TWO_SENSITIVE;
+		if (isOpenCell(colonyList[c].nestX, colonyList[c].nestY) == 0 || colonyList[c].species < 0 || colonyList[c].species >= SPECIES_NUM) {
+			printf ("INVALID COLONY %d\n", c);
+			exit (1);
 		}
-		else {
-			antList[a_n].threshold[0] = THRESHOLD_ONE_INSENSITIVE;
-			antList[a_n].threshold[1] = THRESHOLD_TWO_INSENSITIVE;
+
+		colonyList[c].first = first;
+		colonyList[c].count = 0;
+		colonyList[c].tempCount = 0;
+		colonyList[c].comeBack = 0;
+		colonyList[c].totalAnt = 0;
+
+		first += colonyList[c].population;
+	}
+
+	if (first != ANT_NUM) {
+		printf ("POPULATIONS DO NOT ADD UP TO ANT_NUM\n");
+		exit (1);
+	}
+}
+
+/* Initialize ants structs */
+void antInitialization () {
+	int a_n, c;
+	int r = randomBelow (2);
+	for (c = 0; c < COLONY_NUM; c++) {
+		for (a_n = colonyList[c].first; a_n < colonyList[c].first + colonyList[c].population; a_n++) {
+			antList[a_n].colony = c;
+			antList[a_n].x = colonyList[c].nestX;
+			antList[a_n].y = colonyList[c].nestY;
+			antList[a_n].direction = randomBelow (6);
+			antList[a_n].mode = 1;
+			antList[a_n].vitality = N;
+			antList[a_n].hasFood = 0;
+			antList[a_n].hasComeBack = 0;
+
+			r = randomBelow (2);
+			if (r == 0) {
+				antList[a_n].threshold[0] = param.thresholdOneSensitive;
+				antList[a_n].threshold[1] = param.thresholdTwoSensitive;
+			}
+			else {
+				antList[a_n].threshold[0] = param.thresholdOneInsensitive;
+				antList[a_n].threshold[1] = param.thresholdTwoInsensitive;
+			}
+			antList[a_n].isSensitive = r == 0;
+			colonyList[c].totalAnt++;
 		}
-		totalAnt++;
 	}
 }
 
@@ -525,6 +1700,11 @@ void foodInitialization () {
 	int f;
 	int randomX, randomY;
 
+	if (activeScenario != NULL) {
+		memcpy (foodPos, activeScenario->food, sizeof (foodPos));
+		return;
+	}
+
 	if (DOES_SET_FOOD == 1) {
 		printf ("FOOD PUTTING MODE, JUST COPY AND PASTE\n");
 
@@ -538,58 +1718,221 @@ void foodInitialization () {
 	}
 
 	for (f = 0; f < FOOD_NUM; f++) {
-		randomX = (rand () % L_MAX) + (L_MAX / 2);
-		randomY = (rand () % L_MAX) + (L_MAX / 2);
+		randomX = randomBelow (L_MAX) + (L_MAX / 2);
+		randomY = randomBelow (L_MAX) + (L_MAX / 2);
 
-		while (coordinate[randomX][randomY][0] > L_MAX) {
-			randomX = rand() % (L_MAX * 2 + 1);
-			randomY = rand() % (L_MAX * 2 + 1);
+		while (isOpenCell(randomX, randomY) == 0) {
+			randomX = randomBelow (L_MAX * 2 + 1);
+			randomY = randomBelow (L_MAX * 2 + 1);
 		}
 
-		if (SURROUNDING_MODE == 0) {
-			foodPos[f][0] = randomX;
-			foodPos[f][1] = randomY;
+		placeFood (f, randomX, randomY);
+
+		if (isQuiet == 0) {
+			printf("%d: %d %d\n", f, randomX, randomY);
 		}
-		else {
-			foodPos[7 * f][0] = randomX;
-			foodPos[7 * f][1] = randomY;
+	}
+}
 
-			foodPos[7 * f + 1][0] = randomX;
-			foodPos[7 * f + 1][1] = randomY - 1;
+/* Food patch f at (x, y): one cell, or the cell and its six neighbors */
+void placeFood (int f, int x, int y) {
+	if (SURROUNDING_MODE == 0) {
+		foodPos[f][0] = x;
+		foodPos[f][1] = y;
+	}
+	else {
+		foodPos[7 * f][0] = x;
+		foodPos[7 * f][1] = y;
 
-			foodPos[7 * f + 2][0] = randomX + 1;
-			foodPos[7 * f + 2][1] = randomY - 1;
+		foodPos[7 * f + 1][0] = x;
+		foodPos[7 * f + 1][1] = y - 1;
 
-			foodPos[7 * f + 3][0] = randomX + 1;
-			foodPos[7 * f + 3][1] = randomY;
+		foodPos[7 * f + 2][0] = x + 1;
+		foodPos[7 * f + 2][1] = y - 1;
 
-			foodPos[7 * f + 4][0] = randomX;
-			foodPos[7 * f + 4][1] = randomY + 1;
+		foodPos[7 * f + 3][0] = x + 1;
+		foodPos[7 * f + 3][1] = y;
 
-			foodPos[7 * f + 5][0] = randomX - 1;
-			foodPos[7 * f + 5][1] = randomY + 1;
+		foodPos[7 * f + 4][0] = x;
+		foodPos[7 * f + 4][1] = y + 1;
 
-			foodPos[7 * f + 6][0] = randomX - 1;
-			foodPos[7 * f + 6][1] = randomY;
-		}
+		foodPos[7 * f + 5][0] = x - 1;
+		foodPos[7 * f + 5][1] = y + 1;
 
-		printf("%d: %d %d\n", f, randomX, randomY);
+		foodPos[7 * f + 6][0] = x - 1;
+		foodPos[7 * f + 6][1] = y;
 	}
 }
 
 /* Puts obstacles */
-/*
 void obstacleInitialization () {
-	if (OBSTACLE_MODE == 1) {
-		int o;
-		int randomX, randomY;
+	int o, i, j;
+	int randomX, randomY;
+
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			obstaclePlace[i][j] = 0;
+		}
+	}
+
+	if (activeScenario != NULL) {
+		const short *cell = (const short *) (activeScenario + 1);
 
+		for (o = 0; o < activeScenario->obstacleCount; o++) {
+			placeObstacle (cell[2 * o], cell[2 * o + 1]);
+		}
+	}
+	else if (OBSTACLE_MODE == 1) {
 		for (o = 0; o < OBSTACLE_NUM; o++) {
-			random
+			randomX = randomBelow (L_MAX * 2 + 1);
+			randomY = randomBelow (L_MAX * 2 + 1);
+
+			while (isOpenCell(randomX, randomY) == 0) {
+				randomX = randomBelow (L_MAX * 2 + 1);
+				randomY = randomBelow (L_MAX * 2 + 1);
+			}
+
+			placeObstacle (randomX, randomY);
+
+			if (OBSTACLE_SURROUNDING == 1) {
+				for (i = 0; i < 6; i++) {
+					placeObstacle (randomX + directionX[i], randomY + directionY[i]);
+				}
+			}
+		}
+	}
+	else if (OBSTACLE_MODE == 2) {
+		if (loadObstacleBitmap (OBSTACLE_FILE) == 0) {
+			printf ("FAILED TO LOAD %s, NO OBSTACLES\n", OBSTACLE_FILE);
+		}
+	}
+}
+
+/* Puts a single obstacle, never on a nest or outside */
+void placeObstacle (int x, int y) {
+	if (x < 0 || x > L_MAX * 2 || y < 0 || y > L_MAX * 2) {
+		return;
+	}
+	if (coordinate[x][y][0] > L_MAX) {
+		return;
+	}
+	if (isNest(x, y) == 1) {
+		return;
+	}
+
+	obstaclePlace[x][y] = 1;
+}
+
+/* Loads obstacles from a PBM (P1 or P4) file, scaled onto the hex grid */
+/* a black pixel at (row, column) is an obstacle at hex (x, y) */
+int loadObstacleBitmap (const char *fileName) {
+	FILE *fp;
+	char magic[3];
+	int width, height;
+	int row, col, c, bit;
+	int x, y;
+	unsigned char *pixel;
+
+	if ((fp = fopen (fileName, "rb")) == NULL) {
+		return 0;
+	}
+
+	if (fscanf (fp, "%2s", magic) != 1 || magic[0] != 'P' || (magic[1] != '1' && magic[1] != '4')) {
+		fclose (fp);
+		return 0;
+	}
+
+	/* skip comments between header fields */
+	while ((c = fgetc (fp)) != EOF) {
+		if (c == '#') {
+			while ((c = fgetc (fp)) != EOF && c != '\n');
+		}
+		else if (c > ' ') {
+			ungetc (c, fp);
+			break;
+		}
+	}
+
+	if (fscanf (fp, "%d%d", &width, &height) != 2 || width <= 0 || height <= 0 || width > OBSTACLE_BITMAP_MAX || height > OBSTACLE_BITMAP_MAX) {
+		fclose (fp);
+		return 0;
+	}
+	fgetc (fp);
+
+	if ((pixel = (unsigned char *) malloc ((size_t) width * height)) == NULL) {
+		fclose (fp);
+		return 0;
+	}
+
+	/* a file that ends early is refused rather than padded */
+	for (row = 0; row < height; row++) {
+		for (col = 0; col < width; col++) {
+			if (magic[1] == '1') {
+				if (fscanf (fp, "%1d", &bit) != 1 || bit > 1) {
+					bit = -1;
+				}
+			}
+			else {
+				if (col % 8 == 0 && (c = fgetc (fp)) == EOF) {
+					bit = -1;
+				}
+				else {
+					bit = (c >> (7 - col % 8)) & 1;
+				}
+			}
+			if (bit < 0) {
+				free (pixel);
+				fclose (fp);
+				return 0;
+			}
+			pixel[(size_t) row * width + col] = bit;
+		}
+	}
+	fclose (fp);
+
+	for (x = 0; x < L_MAX * 2 + 1; x++) {
+		for (y = 0; y < L_MAX * 2 + 1; y++) {
+			row = x * height / (L_MAX * 2 + 1);
+			col = y * width / (L_MAX * 2 + 1);
+
+			if (pixel[row * width + col] == 1) {
+				placeObstacle (x, y);
+			}
+		}
+	}
+
+	free (pixel);
+
+	return 1;
+}
+
+/* Precomputes which neighbors of each cell can be entered */
+void passableMaskInitialization () {
+	int i, j, d;
+
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			passableMask[i][j] = 0;
+
+			for (d = 0; d < 6; d++) {
+				if (isOpenCell(i + directionX[d], j + directionY[d]) == 1) {
+					passableMask[i][j] |= 1 << d;
+				}
+			}
 		}
 	}
 }
-*/
+
+/* Whether an ant can stand on (x, y) */
+int isOpenCell (int x, int y) {
+	if (x < 0 || x > L_MAX * 2 || y < 0 || y > L_MAX * 2) {
+		return 0;
+	}
+	if (coordinate[x][y][0] > L_MAX || obstaclePlace[x][y] == 1) {
+		return 0;
+	}
+	return 1;
+}
 
 /* Estimate how long it would take to finish */
 void calculateRemaningTime () {
@@ -603,6 +1946,7 @@ void calculateRemaningTime () {
 	remainingTime = calculationSpeed * (MAX_PROCEDURE - procedureCount) / 60.0;
 }
 
+# ifndef ANTSTRAIL_LIBRARY
 /* draws food on a screen */
 void drawAllFood () {
 	int f;
@@ -622,136 +1966,422 @@ void drawAllFood () {
 	
 }
 
-/* draws nest on a screen */
+/* draws obstacles on a screen, only once since they never move */
+void drawAllObstacles () {
+	int i, j;
+
+	g_sel_scale (1);
+	g_marker_color (5);
+	g_marker_type (-3);
+	g_marker_size (2);
+
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			if (obstaclePlace[i][j] == 1) {
+				g_marker(coordinate[i][j][0], coordinate[i][j][1]);
+			}
+		}
+	}
+}
+
+/* draws nests on a screen */
 void drawNest () {
+	int c;
+
 	g_marker_type (-1);
 	g_marker_size (2);
 
-	g_marker(0, 0);
+	for (c = 0; c < COLONY_NUM; c++) {
+		g_marker(coordinate[colonyList[c].nestX][colonyList[c].nestY][0], coordinate[colonyList[c].nestX][colonyList[c].nestY][1]);
+	}
 }
+# endif
 
 /* Initialize a given ant */
 void initializeGivenAnt (int a_n) {
+	colony *c = &colonyList[antList[a_n].colony];
+
+	trajectorySpawned[a_n] = 1;
+
 	if (antList[a_n].hasComeBack == 1) {
-		comeBack++;
+		c->comeBack++;
 	}
-	totalAnt++;
+	c->totalAnt++;
 
-	antList[a_n].x = L_MAX;
-	antList[a_n].y = L_MAX;
-	antList[a_n].direction = rand() % 6;
+	antList[a_n].x = c->nestX;
+	antList[a_n].y = c->nestY;
+	antList[a_n].direction = randomBelow (6);
 	antList[a_n].mode = 1;
 	antList[a_n].vitality = N;
 	antList[a_n].hasFood = 0;
 	antList[a_n].hasComeBack = 0;
 
-	if (rand () % 2 == 0) {
-		antList[a_n].threshold[0] = THRESHOLD_ONE_SENSITIVE;
-		antList[a_n].threshold[1] = THRESHOLD_TWO_SENSITIVE;
+	antList[a_n].isSensitive = randomBelow (2) == 0;
+	if (antList[a_n].isSensitive) {
+		antList[a_n].threshold[0] = param.thresholdOneSensitive;
+		antList[a_n].threshold[1] = param.thresholdTwoSensitive;
 	}
 	else {
-		antList[a_n].threshold[0] = THRESHOLD_ONE_INSENSITIVE;
-		antList[a_n].threshold[1] = THRESHOLD_TWO_INSENSITIVE;
+		antList[a_n].threshold[0] = param.thresholdOneInsensitive;
+		antList[a_n].threshold[1] = param.thresholdTwoInsensitive;
 	}
 }
 
-/* Stops this program */
-void halt () {
-	createAndWriteInFile();
+/* Whether (x, y) is a nest of some colony */
+int isNest (int x, int y) {
+	int c;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		if (colonyList[c].nestX == x && colonyList[c].nestY == y) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Sum of comeBack over colonies */
+int totalComeBack () {
+	int c;
+	int sum = 0;
 
-	g_sleep(G_STOP);
-	g_term();
+	for (c = 0; c < COLONY_NUM; c++) {
+		sum += colonyList[c].comeBack;
+	}
+	return sum;
+}
+
+/* Sum of totalAnt over colonies */
+int totalAntCount () {
+	int c;
+	int sum = 0;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		sum += colonyList[c].totalAnt;
+	}
+	return sum;
+}
+
+/* Stops this program */
+void halt () {
+	trajectoryClose();
+	heatmapClose();
+	telemetryClose();
+	warmSave();
+	createAndWriteInFile();
+	renderSettle();
+	profileSummary();
+	renderClose();
 }
 
 /* ----------------------------- GRAPHIC ---------------------------------- */
 
+/* drawing is left out of the library, which never opens a window */
+# ifndef ANTSTRAIL_LIBRARY
 /* Progress Bar */
-void progressBar () {
+void progressBar (const renderSnapshot *s) {
 	g_sel_scale (2);
 	g_area_color (7);
 	g_line_color (0);
 
-	g_box (0, procedureCount + 1, 0, 10, 1, 1);
+	g_box (0, s->step + 1, 0, 10, 1, 1);
 }
 
 /* Ratio meter */
-void ratioBar () {
-	int a_n;
-
+void ratioBar (const renderSnapshot *s) {
 	g_sel_scale(3);
 
-	ratio[0] = 0;
-	ratio[1] = 0;
-	ratio[2] = 0;
-
-	for (a_n = 0; a_n < ANT_NUM; a_n++) {
-		ratio[antList[a_n].mode - 1] ++;
-	}
-
 	g_area_color (7);
-	g_box (0, ratio[0], 0, 10, 1, 1);
+	g_box (0, s->ratio[0], 0, 10, 1, 1);
 
 	g_area_color (1);
-	g_box (ratio[0], ratio[0] + ratio[1], 0, 10, 1, 1);
+	g_box (s->ratio[0], s->ratio[0] + s->ratio[1], 0, 10, 1, 1);
 
 	g_area_color (2);
-	g_box (ratio[0] + ratio[1], ANT_NUM, 0, 10, 1, 1);
+	g_box (s->ratio[0] + s->ratio[1], ANT_NUM, 0, 10, 1, 1);
 }
 
 /* Homing meter */
-void homingBar () {
+void homingBar (const renderSnapshot *s) {
 	g_sel_scale (4);
 
 	g_area_color (7);
 	g_box (0, 1, 0, 10, 1, 1);
 
 	g_area_color (6);
-	g_box (0, comeBack / (double)totalAnt, 0, 10, 1, 1);
+	g_box (0, s->homing, 0, 10, 1, 1);
 }
+# endif
 
-/* Normalize pheromones */
-void normalizePheromone () {
+/* Normalize plane k into normalizedPheromone by the tracked max, in one pass */
+void normalizePheromone (int k) {
 	int px, py;
-	double maxOne = 0;
-	double maxTwo = 0;
+	double max = fieldStats[k].max;
+	long long start = profileBegin ();
 
-	/* find max to normalize */
 	for (px = 0; px <= L_MAX * 2; px++) {
 		for (py = 0; py <= L_MAX * 2; py++) {
-			maxOne = fmax (maxOne, pheromone[px][py][0]);
-			maxTwo = fmax (maxTwo, pheromone[px][py][1]);
+			if (pheromone[px][py][k] >= 0 && max > 0) {
+				normalizedPheromone[px][py] = pheromone[px][py][k] / max;
+			}
+			else {
+				normalizedPheromone[px][py] = pheromone[px][py][k] >= 0 ? 0 : -0.1;
+			}
+		}
+	}
 
-			normalizedPheromoneOne[px][py] = -0.1;
-			normalizedPheromoneTwo[px][py] = -0.1;
+	profileEnd (PHASE_NORMALIZATION, start);
+}
+
+# ifndef ANTSTRAIL_LIBRARY
+/* Draws pheromone distribution */
+void drawPheromoneDistribution () {
+	/* pheromone one */
+	normalizePheromone (0);
+	g_hidden(100, 100, 50, 0, 1, 500, 135, 45, 115, 5, 70, 90, (double *)normalizedPheromone, 2 * L_MAX + 1, 2 * L_MAX + 1, 1, 0, 1, 1);
+	/* pheromone two */
+	normalizePheromone (1);
+	g_hidden(100, 100, 50, 0, 1, 500, 135, 45, 215, 5, 70, 90, (double *)normalizedPheromone, 2 * L_MAX + 1, 2 * L_MAX + 1, 1, 0, 1, 1);
+}
+
+/* Starts the render thread, which opens the window and draws the still parts */
+void renderStart () {
+	renderFresh = 0;
+	renderStop = 0;
+	renderFinished = 0;
+	renderHasField = 0;
+	renderPublished = 0;
+	renderDrawn = 0;
+
+	if (pthread_create (&renderThread, NULL, renderLoop, NULL) != 0) {
+		printf ("FAILED TO START RENDER THREAD\n");
+		doesDraw = 0;
+		return;
+	}
+	isRendering = 1;
+}
+# else
+/* A library world has no window to render into */
+void renderStart () {
+	doesDraw = 0;
+}
+# endif
+
+/* Copies what the bars and the field view need, then swaps it in for the renderer */
+void renderPublish (int t) {
+	renderSnapshot *s = renderBack;
+	int a_n;
+
+	s->step = t;
+	s->homing = totalComeBack () / (double)totalAntCount ();
+
+	modeRatio ();
+
+	if (ENGINE == 1) {
+		memset (s->isOut, 0, sizeof (s->isOut));
+	}
+	else {
+		for (a_n = 0; a_n < ANT_NUM; a_n++) {
+			s->isOut[a_n] = antIsOut (a_n);
+			s->mode[a_n] = antList[a_n].mode;
+			s->x[a_n] = antList[a_n].x;
+			s->y[a_n] = antList[a_n].y;
 		}
 	}
+	memcpy (s->ratio, ratio, sizeof (ratio));
+
+	pthread_mutex_lock (&renderLock);
+	renderBack = renderFront;
+	renderFront = s;
+	renderFresh = 1;
+	renderPublished++;
+	pthread_cond_signal (&renderCond);
+	pthread_mutex_unlock (&renderLock);
+}
 
-	/* normalize */
-	for (px = 0; px <= L_MAX * 2; px++) {
-		for (py = 0; py <= L_MAX * 2; py++) {
-			if (pheromone[px][py][0] >= 0) {
-				normalizedPheromoneOne[px][py] = pheromone[px][py][0] / maxOne;
-			}
+/* Counts ants in each mode into ratio */
+void modeRatio () {
+	int a_n;
+
+	ratio[0] = 0;
+	ratio[1] = 0;
+	ratio[2] = 0;
+
+	if (ENGINE == 1) {
+		meanFieldRatio ();
+	}
+	else {
+		for (a_n = 0; a_n < ANT_NUM; a_n++) {
+			ratio[antList[a_n].mode - 1] ++;
+		}
+	}
+}
+
+/* Has the renderer draw the field last, once the run is over */
+void renderFinal () {
+	pthread_mutex_lock (&renderLock);
+	renderHasField = 1;
+	pthread_mutex_unlock (&renderLock);
+}
+
+/* Waits until the renderer has drawn everything, so its times are in the profile */
+void renderSettle () {
+	if (isRendering == 0) {
+		return;
+	}
+
+	pthread_mutex_lock (&renderLock);
+	renderStop = 1;
+	pthread_cond_broadcast (&renderCond);
+	while (renderFinished == 0) {
+		pthread_cond_wait (&renderCond, &renderLock);
+	}
+	pthread_mutex_unlock (&renderLock);
+}
+
+/* Lets the renderer finish; it keeps the window until it is closed */
+void renderClose () {
+	if (isRendering == 0) {
+		return;
+	}
+
+	pthread_mutex_lock (&renderLock);
+	renderStop = 1;
+	pthread_cond_signal (&renderCond);
+	pthread_mutex_unlock (&renderLock);
+	pthread_join (renderThread, NULL);
+	isRendering = 0;
+
+	if (isQuiet == 0) {
+		printf ("%d / %d frames drawn\n", renderDrawn, renderPublished);
+	}
+}
+
+# ifndef ANTSTRAIL_LIBRARY
+/* Render thread: draws the newest snapshot at its own pace */
+void *renderLoop (void *arg) {
+	int hasField;
+
+	graphicInitialization();
+	backgroundInitialization();
+	instructionInitialization();
+	boxExplanation ();
+	frameInitialization ();
+
+	pthread_mutex_lock (&renderLock);
+	while (1) {
+		while (renderFresh == 0 && renderStop == 0) {
+			pthread_cond_wait (&renderCond, &renderLock);
+		}
+		if (renderFresh == 0) {
+			break;
+		}
+		memcpy (&renderFrame, renderFront, sizeof (renderFrame));
+		renderFresh = 0;
+		pthread_mutex_unlock (&renderLock);
+
+		renderDraw (&renderFrame);
+		renderDrawn++;
+		g_sleep (FPS);
+
+		pthread_mutex_lock (&renderLock);
+	}
+	hasField = renderHasField;
+	pthread_mutex_unlock (&renderLock);
+
+	if (hasField) {
+		drawPheromoneDistribution ();
+	}
+
+	pthread_mutex_lock (&renderLock);
+	renderFinished = 1;
+	pthread_cond_broadcast (&renderCond);
+	pthread_mutex_unlock (&renderLock);
+
+	g_sleep (G_STOP);
+	g_term ();
+
+	return arg;
+}
+
+/* Rasterizes the ants over the still parts, presents the frame and redraws the bars */
+void renderDraw (const renderSnapshot *s) {
+	int a_n;
+
+	memcpy (frameColor, frameBase, sizeof (frameColor));
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		if (s->isOut[a_n]) {
+			frameColor[framePixel[s->x[a_n]][s->y[a_n]]] = s->mode[a_n] == 1 ? 7 : s->mode[a_n] == 2 ? 1 : 2;
+		}
+	}
+	framePresent ();
+
+	progressBar (s);
+	ratioBar (s);
+	homingBar (s);
+}
+
+/* Maps every cell to its pixel and draws obstacles and food into frameBase */
+void frameInitialization () {
+	int i, j, f, px, py;
+	int foodCount = SURROUNDING_MODE == 0 ? FOOD_NUM : FOOD_NUM * 7;
+
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			px = (int) floor ((coordinate[i][j][0] + L_MAX * 1.1) * FRAME_SCALE + 0.5);
+			py = (int) floor ((coordinate[i][j][1] + L_MAX * 1.1) * FRAME_SCALE + 0.5);
+			framePixel[i][j] = py * FRAME_SIZE + px;
+		}
+	}
+
+	/* the view box is filled with color 0 by backgroundInitialization */
+	memset (frameBase, 0, sizeof (frameBase));
+	memset (framePresented, 0, sizeof (framePresented));
 
-			if (pheromone[px][py][0] >= 0) {
-				normalizedPheromoneTwo[px][py] = pheromone[px][py][1] / maxTwo;
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			if (obstaclePlace[i][j] == 1) {
+				frameBase[framePixel[i][j]] = 5;
 			}
 		}
 	}
+	for (f = 0; f < foodCount; f++) {
+		frameBase[framePixel[foodPos[f][0]][foodPos[f][1]]] = 3;
+	}
 }
 
-/* Draws pheromone distribution */
-void drawPheromoneDistribution () {
-	normalizePheromone ();
+/* Sends the pixels that changed since the last frame, one box per run */
+void framePresent () {
+	double half = 0.5 / FRAME_SCALE;
+	double x0, y;
+	int px, py, q, p;
 
-	/* pheromone one */
-	g_hidden(100, 100, 50, 0, 1, 500, 135, 45, 115, 5, 70, 90, (double *)normalizedPheromoneOne, 2 * L_MAX + 1, 2 * L_MAX + 1, 1, 0, 1, 1);
-	/* pheromone two */
-	g_hidden(100, 100, 50, 0, 1, 500, 135, 45, 215, 5, 70, 90, (double *)normalizedPheromoneTwo, 2 * L_MAX + 1, 2 * L_MAX + 1, 1, 0, 1, 1);
+	g_sel_scale (1);
+	for (py = 0; py < FRAME_SIZE; py++) {
+		y = py / (double) FRAME_SCALE - L_MAX * 1.1;
+
+		for (px = 0; px < FRAME_SIZE; px++) {
+			p = py * FRAME_SIZE + px;
+			if (frameColor[p] == framePresented[p]) {
+				continue;
+			}
+
+			/* a run of one color, as long as it still needs drawing */
+			for (q = px + 1; q < FRAME_SIZE && frameColor[p + q - px] == frameColor[p] && frameColor[p + q - px] != framePresented[p + q - px]; q++);
+
+			x0 = px / (double) FRAME_SCALE - L_MAX * 1.1;
+			g_area_color (frameColor[p]);
+			g_box (x0 - half, x0 + (q - px) / (double) FRAME_SCALE - half, y - half, y + half, 0, 1);
+
+			px = q - 1;
+		}
+	}
+	memcpy (framePresented, frameColor, sizeof (framePresented));
 }
+# endif
 
 /* ------------------------- ANT_BEHAVIOR --------------------------------- */
 
+# ifndef ANTSTRAIL_LIBRARY
 /* Single Ant movement */
 void singleAntMovement (int a_n) {
 	int n;
@@ -761,27 +2391,27 @@ void singleAntMovement (int a_n) {
 		g_sleep(FPS);
 	}
 }
+# endif
 
 /* Only single movement */
 void singleMovement (int a_n) {
-	plotAnt(a_n, 0);
-	
-	g_sel_scale (1);
+	int mode = antList[a_n].mode;
+
 	/* MoveAnt */
 	if (antList[a_n].mode == 1) {
 		movementOne(a_n);
-		plotAnt(a_n, 7);
 	}
 	else if (antList[a_n].mode == 2) {
 		movementTwo(a_n);
-		plotAnt(a_n, 1);
 	}
 	else if (antList[a_n].mode == 3) {
 		movementThree(a_n);
-		plotAnt(a_n, 2);
 	}
+
+	eventCount[EVENT_MODE_CHANGE] += (antList[a_n].mode != mode);
 }
 
+# ifndef ANTSTRAIL_LIBRARY
 /* Multi Thread Mode */ 
 void multipleMovement () {
 	int a_n, n;
@@ -796,71 +2426,122 @@ void multipleMovement () {
 		g_sleep(FPS);
 	}
 }
+# endif
 
 /* Consectively comes out from the nest */
-void consecutiveMovement () {
-	int n, a_n;
-	int t = 0;
-	int count = 0;
-	int tempCount = 0;
+/* every colony grows by its own lug and then keeps its population */
+/* runs steps t ~ end - 1 */
+void consecutiveMovement (int t, int end) {
+	while (t < end) {
+		consecutiveStep (t);
+		t++;
+
+		if (convergeCheck (t)) {
+			return;
+		}
+		if (CHECKPOINT_INTERVAL > 0 && t % CHECKPOINT_INTERVAL == 0 && t < MAX_PROCEDURE) {
+			checkpointWrite (t);
+		}
+	}
+
+	if (t >= MAX_PROCEDURE) {
+		stopStep = MAX_PROCEDURE;
+		stopReason = STOP_MAX_PROCEDURE;
+	}
+}
 
-	while (t < MAX_PROCEDURE) {
-		g_sel_scale (1);
-		if (count <= ANT_NUM) {
-			for (a_n = 0; a_n < count; a_n ++) {
+/* A single procedure of consecutiveMovement */
+void consecutiveStep (int t) {
+	int a_n, c, last;
+	long long start;
+	colony *col;
+
+	profileSample (t);
+	start = profileBegin ();
+	for (c = 0; c < COLONY_NUM; c++) {
+		col = &colonyList[c];
+		last = col->first + col->population;
+
+		if (col->count <= col->population) {
+			for (a_n = col->first; a_n < col->first + col->count; a_n ++) {
 				singleMovement (a_n);
 			}
 
-			tempCount ++;
+			col->tempCount ++;
 
-			if (tempCount > LUG) {
-				count++;
-				tempCount = 0;
+			if (col->tempCount > col->lug) {
+				col->count++;
+				col->tempCount = 0;
 			}
-			g_sleep(FPS);
 		}
 		else {
-			for (a_n = 0; a_n < ANT_NUM; a_n++) {
+			for (a_n = col->first; a_n < last; a_n++) {
 				if (antList[a_n].vitality < 0) {
-					plotAnt(a_n, 0);
 					initializeGivenAnt(a_n);
 				}
 				singleMovement (a_n);
 			}
-
-			g_sleep(FPS);
 		}
-		drawAllFood ();
+	}
+	profileEnd (PHASE_ANT, start);
+	profileSampleEnd ();
+
+	trajectoryRecord (t);
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		homingProb[c] = colonyList[c].comeBack / (double)colonyList[c].totalAnt;
+		homingNum[c] = colonyList[c].comeBack;
+	}
+	seriesRecord (t);
 
-		procedureCount = t;
+	finishProcedure (t);
+}
 
-		g_sel_scale (2);
-		progressBar ();
+/* Bars, pheromone and time estimation shared by both engines */
+void finishProcedure (int t) {
+	long long start = profileBegin ();
 
-		g_sel_scale (3);
-		ratioBar ();
+	procedureCount = t;
 
-		g_sel_scale (4);
-		homingBar ();
+	if (doesDraw && t % RENDER_INTERVAL == 0) {
+		renderPublish (t);
+	}
 
-		pheromoneBehavior ();
+	profileEnd (PHASE_RENDERING, start);
 
-		homingProb[t] = comeBack / (double)totalAnt;
-		homingNum[t] = comeBack;
+	pheromoneBehavior ();
 
-		if (t % N == 0) {
-			calculateRemaningTime ();
-			printf ("%03.1lfmin left\n", remainingTime);
-		}
+	if (isExporting && t % heatmapInterval == 0) {
+		heatmapCapture (t);
+	}
+	if (telemetry != NULL && t % TELEMETRY_INTERVAL == 0) {
+		telemetryPublish (t);
+	}
+	if (jobProgress != NULL) {
+		*jobProgress = t + 1;
+	}
 
-		t++;
+	if (t % N == 0 && isQuiet == 0) {
+		calculateRemaningTime ();
+		printf ("%03.1lfmin left\n", remainingTime);
 	}
+
+	profileStep (t);
 }
 
 /* Mode 1 (Random movement mode) */
 void movementOne (int a_n) {
-	pheromone[antList[a_n].x][antList[a_n].y][0] += PHEROMONE_RELEASE_ONE;
-	moveToGivenDirection(calculateDirection(1, antList[a_n].direction, a_n), a_n);
+	int dir;
+	long long start = profileBegin ();
+
+	pheromone[antList[a_n].x][antList[a_n].y][2 * colonyList[antList[a_n].colony].species] += param.pheromoneReleaseOne;
+	profileEnd (PHASE_DEPOSITION, start);
+
+	start = profileBegin ();
+	dir = calculateDirection(1, antList[a_n].direction, a_n);
+	profileEnd (PHASE_DIRECTION, start);
+
+	moveToGivenDirection(dir, a_n);
 
 	antList[a_n].vitality --;
 	/* becomes mode 2 if there is enough pheromone around */
@@ -880,8 +2561,17 @@ void movementOne (int a_n) {
 
 /* Mode 2 (Pheromone searching mode) */
 void movementTwo (int a_n) {
-	pheromone[antList[a_n].x][antList[a_n].y][0] += PHEROMONE_RELEASE_ONE;
-	moveToGivenDirection(calculateDirection(2, antList[a_n].direction, a_n), a_n);
+	int dir;
+	long long start = profileBegin ();
+
+	pheromone[antList[a_n].x][antList[a_n].y][2 * colonyList[antList[a_n].colony].species] += param.pheromoneReleaseOne;
+	profileEnd (PHASE_DEPOSITION, start);
+
+	start = profileBegin ();
+	dir = calculateDirection(2, antList[a_n].direction, a_n);
+	profileEnd (PHASE_DIRECTION, start);
+
+	moveToGivenDirection(dir, a_n);
 
 	antList[a_n].vitality --;
 	/* becomes mode 1 if there is not enough pheromone around */
@@ -901,8 +2591,17 @@ void movementTwo (int a_n) {
 
 /* Mode 3 (Homing mode) */
 void movementThree (int a_n) {
-	pheromone[antList[a_n].x][antList[a_n].y][1] += PHEROMONE_RELEASE_TWO;
-	moveToGivenDirection(calculateDirection(3, antList[a_n].direction, a_n), a_n);
+	int dir;
+	long long start = profileBegin ();
+
+	pheromone[antList[a_n].x][antList[a_n].y][2 * colonyList[antList[a_n].colony].species + 1] += param.pheromoneReleaseTwo;
+	profileEnd (PHASE_DEPOSITION, start);
+
+	start = profileBegin ();
+	dir = calculateDirection(3, antList[a_n].direction, a_n);
+	profileEnd (PHASE_DIRECTION, start);
+
+	moveToGivenDirection(dir, a_n);
 
 
 	antList[a_n].vitality --;
@@ -911,6 +2610,7 @@ void movementThree (int a_n) {
 		//printf("%d: Has GONE BACK\n", a_n);
 		antList[a_n].hasComeBack = 1;
 		antList[a_n].vitality = 0;
+		eventCount[EVENT_RETURN]++;
 	}
 }
 
@@ -923,6 +2623,7 @@ int hasDiscoveredFood (int a_n) {
 			if (antList[a_n].x == foodPos[f][0] && antList[a_n].y == foodPos[f][1]) {
 				//printf("%d DISCOVERED! at %d\n", a_n, f);
 				antList[a_n].hasFood = 1;
+				eventCount[EVENT_FOOD]++;
 				return 1;
 			}
 		}
@@ -932,6 +2633,7 @@ int hasDiscoveredFood (int a_n) {
 			if (antList[a_n].x == foodPos[f][0] && antList[a_n].y == foodPos[f][1]) {
 				//printf("%d DISCOVERED! at %d\n", a_n, f);
 				antList[a_n].hasFood = 1;
+				eventCount[EVENT_FOOD]++;
 				return 1;
 			}
 		}
@@ -942,16 +2644,15 @@ int hasDiscoveredFood (int a_n) {
 
 /* Calculate Direction */
 int calculateDirection (int mode, int dir, int a_n) {
-	int randomDir, i, s;
+	int randomDir, s;
 	int maxDir;
 	int surroundingPheromone[6];
-	double normalizedSurrounding[6];
 	int monteCalro;
 	int whichPheromone;
 
 	/* for mode one */
 	if (mode == 1) {
-		randomDir = rand() % 3;
+		randomDir = randomBelow (3);
 
 		/* Up */
 		if (dir == 0) {
@@ -1035,54 +2736,15 @@ int calculateDirection (int mode, int dir, int a_n) {
 		else {
 			whichPheromone = 0;
 		}
-
-		/* Initialize */
-		for (i = 0; i < 6; i++) {
-			surroundingPheromone[i] = 1;
-		}
+		whichPheromone += 2 * colonyList[antList[a_n].colony].species;
 
 		/* Calculating (Surrounding) */
-		/* Up */
-		if (antList[a_n].x - 1 >= 0) {
-			if (coordinate[antList[a_n].x - 1][antList[a_n].y][0] <= L_MAX) {
-				surroundingPheromone[0] += (int)INCREMENT * pheromone[antList[a_n].x - 1][antList[a_n].y][whichPheromone];
-			}
-		}
-		/* Right up */
-		if (antList[a_n].x - 1 >= 0 && antList[a_n].y + 1 <= L_MAX * 2) {
-			if (coordinate[antList[a_n].x - 1][antList[a_n].y + 1][0] <= L_MAX) {
-				surroundingPheromone[1] += (int)INCREMENT * pheromone[antList[a_n].x - 1][antList[a_n].y + 1][whichPheromone];		
-			}	
-		}
-		/* Right down */
-		if (antList[a_n].y + 1 <= L_MAX * 2) {
-			if (coordinate[antList[a_n].x][antList[a_n].y + 1][0] <= L_MAX) {
-				surroundingPheromone[2] += (int)INCREMENT * pheromone[antList[a_n].x][antList[a_n].y + 1][whichPheromone];	
-			}
-		}
-		/* Down */
-		if (antList[a_n].x + 1 <= L_MAX * 2) {
-			if (coordinate[antList[a_n].x + 1][antList[a_n].y][0] <= L_MAX) {
-				surroundingPheromone[3] += (int)INCREMENT * pheromone[antList[a_n].x + 1][antList[a_n].y][whichPheromone];	
-			}
-		}
-		/* Left down */
-		if (antList[a_n].x + 1 <= L_MAX * 2 && antList[a_n].y - 1 >= 0) {
-			if (coordinate[antList[a_n].x + 1][antList[a_n].y - 1][0] <= L_MAX) {
-				surroundingPheromone[4] += (int)INCREMENT * pheromone[antList[a_n].x + 1][antList[a_n].y - 1][whichPheromone];				
-			}
-		}
-		/* Left up */
-		if (antList[a_n].y - 1 >= 0) {
-			if (coordinate[antList[a_n].x][antList[a_n].y - 1][0] <= L_MAX) {
-				surroundingPheromone[5] += (int)INCREMENT * pheromone[antList[a_n].x][antList[a_n].y - 1][whichPheromone];
-			}
-		}
+		surroundingPheromoneAt(antList[a_n].x, antList[a_n].y, whichPheromone, surroundingPheromone);
 
 		maxDir = 0;
 		for (s = 0; s < 6; s++) {
 			if (surroundingPheromone[s] < 0) {
-				surroundingPheromone[s] = RAND_MAX;
+				surroundingPheromone[s] = RANDOM_MAX;
 			}
 
 			if (surroundingPheromone[s] > surroundingPheromone[maxDir]) {
@@ -1096,7 +2758,7 @@ int calculateDirection (int mode, int dir, int a_n) {
 		/* Up */
 		if (dir == 0) {
 			monteCalro = surroundingPheromone[0] + surroundingPheromone[1] + surroundingPheromone[5];
-			randomDir = (rand() % monteCalro);
+			randomDir = randomBelow (monteCalro);
 
 			/*
 			if (surroundingPheromone[0] > surroundingPheromone[1]) {
@@ -1131,7 +2793,7 @@ int calculateDirection (int mode, int dir, int a_n) {
 		else if (dir == 1) {
 			monteCalro = surroundingPheromone[1] + surroundingPheromone[2] + surroundingPheromone[0];
 			
-			randomDir = (rand() % monteCalro);
+			randomDir = randomBelow (monteCalro);
 
 			/*
 			if (surroundingPheromone[2] > surroundingPheromone[0]) {
@@ -1166,7 +2828,7 @@ int calculateDirection (int mode, int dir, int a_n) {
 		else if (dir == 2) {
 			monteCalro = surroundingPheromone[2] + surroundingPheromone[3] + surroundingPheromone[1];
 			
-			randomDir = (rand() % monteCalro);
+			randomDir = randomBelow (monteCalro);
 
 			/*
 			if (surroundingPheromone[2] > surroundingPheromone[3]) {
@@ -1201,7 +2863,7 @@ int calculateDirection (int mode, int dir, int a_n) {
 		else if (dir == 3) {
 			monteCalro = surroundingPheromone[3] + surroundingPheromone[4] + surroundingPheromone[2];
 
-			randomDir = (rand() % monteCalro);
+			randomDir = randomBelow (monteCalro);
 
 			/*
 			if (surroundingPheromone[3] > surroundingPheromone[4]) {
@@ -1236,7 +2898,7 @@ int calculateDirection (int mode, int dir, int a_n) {
 		else if (dir == 4) {
 			monteCalro = surroundingPheromone[4] + surroundingPheromone[5] + surroundingPheromone[3];
 
-			randomDir = (rand() % monteCalro);
+			randomDir = randomBelow (monteCalro);
 
 			/*
 			if (surroundingPheromone[4] > surroundingPheromone[5]) {
@@ -1271,7 +2933,7 @@ int calculateDirection (int mode, int dir, int a_n) {
 		else if (dir == 5) {
 			monteCalro = surroundingPheromone[5] + surroundingPheromone[0] + surroundingPheromone[4];
 
-			randomDir = (rand() % monteCalro);
+			randomDir = randomBelow (monteCalro);
 
 			/*
 			if (surroundingPheromone[5] > surroundingPheromone[0]) {
@@ -1307,18 +2969,34 @@ int calculateDirection (int mode, int dir, int a_n) {
 	return -1;
 }
 
-/* Calculate probability of the direction */
-int calculateProb (int tempPheromone[6], int dir) {
-	int d, random;
-	int monteCalro;
+/* Sums up pheromone around (x, y) on a given plane */
+/* neighbors that cannot be entered keep 1 */
+void surroundingPheromoneAt (int x, int y, int plane, int surroundingPheromone[6]) {
+	int i;
+	int mask = passableMask[x][y];
+	long long start = profileBegin ();
+
+	for (i = 0; i < 6; i++) {
+		surroundingPheromone[i] = 1;
+
+		if ((mask >> i) & 1) {
+			surroundingPheromone[i] += (int)INCREMENT * pheromone[x + directionX[i]][y + directionY[i]][plane];
+		}
+	}
+
+	profileEnd (PHASE_SENSING, start);
+}
+
+/* Weight of each direction, the probability is proportional to it */
+void calculateWeight (int tempPheromone[6], int surrounding[6]) {
+	int d;
 	int inc = 16;
-	double max;
+	double max = 0;
 	double normalizedSurrounding[6];
-	int surrounding[6];
 
 	for (d = 0; d < 6; d++) {
 		if (tempPheromone[d] < 0) {
-			tempPheromone[d] = RAND_MAX;
+			tempPheromone[d] = RANDOM_MAX;
 		}
 
 		max = fmax(max, tempPheromone[d]);
@@ -1328,10 +3006,19 @@ int calculateProb (int tempPheromone[6], int dir) {
 		normalizedSurrounding[d] = tempPheromone[d] / max;
 		surrounding[d] = (int) exp (inc * normalizedSurrounding[d]);
 	}
+}
+
+/* Calculate probability of the direction */
+int calculateProb (int tempPheromone[6], int dir) {
+	int random;
+	int monteCalro;
+	int surrounding[6];
+
+	calculateWeight (tempPheromone, surrounding);
 
 	if (dir == 0) {
 		monteCalro = surrounding[5] + surrounding[0] + surrounding[1];
-		random = rand () % monteCalro;
+		random = randomBelow (monteCalro);
 		
 		if (random < surrounding[5]) {
 			return 5;
@@ -1345,7 +3032,7 @@ int calculateProb (int tempPheromone[6], int dir) {
 	}
 	else if (dir == 1) {
 		monteCalro = surrounding[0] + surrounding[1] + surrounding[2];
-		random = rand () % monteCalro;
+		random = randomBelow (monteCalro);
 		
 		if (random < surrounding[0]) {
 			return 0;
@@ -1359,7 +3046,7 @@ int calculateProb (int tempPheromone[6], int dir) {
 	}
 	else if (dir == 2) {
 		monteCalro = surrounding[1] + surrounding[2] + surrounding[3];
-		random = rand () % monteCalro;
+		random = randomBelow (monteCalro);
 		
 		if (random < surrounding[1]) {
 			return 1;
@@ -1373,7 +3060,7 @@ int calculateProb (int tempPheromone[6], int dir) {
 	}
 	else if (dir == 3) {
 		monteCalro = surrounding[2] + surrounding[3] + surrounding[4];
-		random = rand () % monteCalro;
+		random = randomBelow (monteCalro);
 		
 		if (random < surrounding[2]) {
 			return 2;
@@ -1387,7 +3074,7 @@ int calculateProb (int tempPheromone[6], int dir) {
 	}
 	else if (dir == 4) {
 		monteCalro = surrounding[3] + surrounding[4] + surrounding[5];
-		random = rand () % monteCalro;
+		random = randomBelow (monteCalro);
 		
 		if (random < surrounding[3]) {
 			return 3;
@@ -1401,7 +3088,7 @@ int calculateProb (int tempPheromone[6], int dir) {
 	}
 	else if (dir == 5) {
 		monteCalro = surrounding[4] + surrounding[5] + surrounding[0];
-		random = rand () % monteCalro;
+		random = randomBelow (monteCalro);
 		
 		if (random < surrounding[4]) {
 			return 4;
@@ -1418,75 +3105,59 @@ int calculateProb (int tempPheromone[6], int dir) {
 }
 
 /* Single movement */
+/* stays at the same cell if the direction is blocked, but still faces it */
 void moveToGivenDirection (int dir, int a_n) {
-	/* Up */
-	if (dir == 0) {
-		if (antList[a_n].x - 1 >= 0) {
-			if (coordinate[antList[a_n].x - 1][antList[a_n].y][0] <= L_MAX) {
-				antList[a_n].x --;			
-			}
-		}
-		antList[a_n].direction = 0;	
-	}
-	/* Right up */
-	else if (dir == 1) {
-		if (antList[a_n].x - 1 >= 0 && antList[a_n].y + 1 <= L_MAX * 2) {
-			if (coordinate[antList[a_n].x - 1][antList[a_n].y + 1][0] <= L_MAX) {
-				antList[a_n].x --;
-				antList[a_n].y ++;				
-			}	
-		}
-		antList[a_n].direction = 1;
- 	}
- 	/* Right down */
-	else if (dir == 2) {
-		if (antList[a_n].y + 1 <= L_MAX * 2) {
-			if (coordinate[antList[a_n].x][antList[a_n].y + 1][0] <= L_MAX) {
-				antList[a_n].y ++;
-			}
-		}
-		antList[a_n].direction = 2;
-	}
-	/* Down */
-	else if (dir == 3) {
-		if (antList[a_n].x + 1 <= L_MAX * 2) {
-			if (coordinate[antList[a_n].x + 1][antList[a_n].y][0] <= L_MAX) {
-				antList[a_n].x ++;
-			}
-		}
-		antList[a_n].direction = 3;
-	}
-	/* Left down */
-	else if (dir == 4) {
-		if (antList[a_n].x + 1 <= L_MAX * 2 && antList[a_n].y - 1 >= 0) {
-			if (coordinate[antList[a_n].x + 1][antList[a_n].y - 1][0] <= L_MAX) {
-				antList[a_n].x ++;
-				antList[a_n].y --;				
-			}
-		}
-		antList[a_n].direction = 4;
-	}
-	/* Left up */
-	else if (dir == 5) {
-		if (antList[a_n].y - 1 >= 0) {
-			if (coordinate[antList[a_n].x][antList[a_n].y - 1][0] <= L_MAX) {
-				antList[a_n].y --;
-			}
-		}
-		antList[a_n].direction = 5;
+	int canMove;
+
+	if (dir < 0 || dir > 5) {
+		return;
 	}
+
+	canMove = (passableMask[antList[a_n].x][antList[a_n].y] >> dir) & 1;
+	eventCount[EVENT_WALL] += 1 - canMove;
+
+	antList[a_n].x += canMove * directionX[dir];
+	antList[a_n].y += canMove * directionY[dir];
+	antList[a_n].direction = dir;
 }
+
+# ifndef ANTSTRAIL_LIBRARY
 /* Plot a_n'th ant with given color */
 void plotAnt (int a_n, int color) {
+	long long start;
+
+	if (doesDraw == 0) {
+		return;
+	}
+
+	start = profileBegin ();
+
+	plotCell (antList[a_n].x, antList[a_n].y, color);
+
+	profileEnd (PHASE_RENDERING, start);
+}
+
+/* Plot an ant sized marker on cell (x, y) */
+void plotCell (int x, int y, int color) {
 	g_marker_size(1);
 	g_marker_type(0);
 	g_marker_color(color);
-	g_marker(coordinate[antList[a_n].x][antList[a_n].y][0], coordinate[antList[a_n].x][antList[a_n].y][1]);
+	g_marker(coordinate[x][y][0], coordinate[x][y][1]);
+}
+# endif
+
+/* 1 if a_n has left the nest: a growing colony lets out its first count ants */
+int antIsOut (int a_n) {
+	colony *c = &colonyList[antList[a_n].colony];
+
+	return c->count > c->population || a_n < c->first + c->count;
 }
 
 /* Checks whether an ant has gone back to the colony */
 int hasGoneBack (int a_n) {
-	if (antList[a_n].x == L_MAX && antList[a_n].y == L_MAX) {
+	colony *c = &colonyList[antList[a_n].colony];
+
+	if (antList[a_n].x == c->nestX && antList[a_n].y == c->nestY) {
 		return 1;
 	}
 	return 0;
@@ -1494,194 +3165,5081 @@ int hasGoneBack (int a_n) {
 
 /* Checks whether there is site where pheromone is over threshold */
 int checkPheromone (int a_n, int pheromone_num) {
-	/* Up */
-	if (antList[a_n].y - 1 >= 0) {
-		if (pheromone[antList[a_n].x][antList[a_n].y - 1][pheromone_num] >= antList[a_n].threshold[pheromone_num]) {
-			return 1;
+	int d;
+	int x = antList[a_n].x;
+	int y = antList[a_n].y;
+	int mask = passableMask[x][y];
+	int plane = 2 * colonyList[antList[a_n].colony].species + pheromone_num;
+	int found = 0;
+	long long start = profileBegin ();
+
+	for (d = 0; d < 6; d++) {
+		if ((mask >> d) & 1) {
+			if (pheromone[x + directionX[d]][y + directionY[d]][plane] >= antList[a_n].threshold[pheromone_num]) {
+				found = 1;
+				break;
+			}
 		}
 	}
 
-	/* Right up */
-	if (antList[a_n].x + 1 <= L_MAX * 2 && antList[a_n].y - 1 >= 0) {
-		if (pheromone[antList[a_n].x + 1][antList[a_n].y - 1][pheromone_num] >= antList[a_n].threshold[pheromone_num]) {
-			return 1;			
+	profileEnd (PHASE_SENSING, start);
+
+	return found;
+}
+
+/* ------------------------- MEAN FIELD -------------------------------- */
+
+/* Starts with every colony at its nest, nobody out yet */
+void meanFieldInitialization () {
+	int c, f, x, y, m, d;
+
+	for (x = 0; x <= L_MAX * 2; x++) {
+		for (y = 0; y <= L_MAX * 2; y++) {
+			foodPlace[x][y] = 0;
+
+			for (c = 0; c < COLONY_NUM; c++) {
+				for (m = 0; m < 3; m++) {
+					for (d = 0; d < 6; d++) {
+						density[c][x][y][m][d] = 0;
+					}
+				}
+			}
 		}
 	}
 
-	/* Right down */
-	if (antList[a_n].x + 1 <= L_MAX * 2) {
-		if (pheromone[antList[a_n].x + 1][antList[a_n].y][pheromone_num] >= antList[a_n].threshold[pheromone_num]) {
-			return 1;
+	for (f = 0; f < (SURROUNDING_MODE == 0 ? FOOD_NUM : FOOD_NUM * 7); f++) {
+		foodPlace[foodPos[f][0]][foodPos[f][1]] = 1;
+	}
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		meanFieldComeBack[c] = 0;
+		meanFieldTotal[c] = colonyList[c].population;
+	}
+	for (m = 0; m < EVENT_NUM; m++) {
+		meanFieldEvent[m] = 0;
+	}
+}
+
+/* Whole ants of each event go to eventCount, the fractions wait for the next step */
+void meanFieldEvents () {
+	int i;
+	double whole;
+
+	for (i = 0; i < EVENT_NUM; i++) {
+		whole = floor (meanFieldEvent[i]);
+		eventCount[i] += (long long) whole;
+		meanFieldEvent[i] -= whole;
+	}
+}
+
+/* Same schedule as consecutiveMovement, but on densities */
+void meanFieldMovement (int t, int end) {
+	int c;
+	colony *col;
+
+	long long start;
+
+	while (t < end) {
+		profileSample (t);
+		start = profileBegin ();
+		meanFieldStep ();
+		profileEnd (PHASE_ANT, start);
+		profileSampleEnd ();
+		meanFieldEvents ();
+
+		for (c = 0; c < COLONY_NUM; c++) {
+			col = &colonyList[c];
+
+			/* growing colony: one more ant every lug */
+			if (col->count <= col->population) {
+				col->tempCount ++;
+
+				if (col->tempCount > col->lug && col->count < col->population) {
+					col->count++;
+					col->tempCount = 0;
+					meanFieldSpread (c, col->nestX, col->nestY, 1);
+				}
+			}
+
+			col->comeBack = (int) (meanFieldComeBack[c] + 0.5);
+			col->totalAnt = (int) (meanFieldTotal[c] + 0.5);
+
+			homingProb[c] = meanFieldComeBack[c] / meanFieldTotal[c];
+			homingNum[c] = col->comeBack;
+		}
+		seriesRecord (t);
+		finishProcedure (t);
+
+		t++;
+
+		if (convergeCheck (t)) {
+			return;
+		}
+		if (CHECKPOINT_INTERVAL > 0 && t % CHECKPOINT_INTERVAL == 0 && t < MAX_PROCEDURE) {
+			checkpointWrite (t);
 		}
 	}
 
-	/* Down */
-	if (antList[a_n].y + 1 <= L_MAX * 2) {
-		if (pheromone[antList[a_n].x][antList[a_n].y + 1][pheromone_num] >= antList[a_n].threshold[pheromone_num]) {
-			return 1;
+	if (t >= MAX_PROCEDURE) {
+		stopStep = MAX_PROCEDURE;
+		stopReason = STOP_MAX_PROCEDURE;
+	}
+}
+
+/* One procedure: deposit, move along the forward cone, then change modes */
+void meanFieldStep () {
+	int c, x, y, m, d, k, sp, nd, canMove, mask;
+	int surroundingPheromone[6];
+	int weight[6];
+	int cone[3];
+	double p[3], part[3];
+	double mass, search, home, sum;
+
+	/* deposit straight from the counts */
+	for (c = 0; c < COLONY_NUM; c++) {
+		sp = colonyList[c].species;
+
+		for (x = 0; x <= L_MAX * 2; x++) {
+			for (y = 0; y <= L_MAX * 2; y++) {
+				search = 0;
+				home = 0;
+
+				for (d = 0; d < 6; d++) {
+					search += density[c][x][y][0][d] + density[c][x][y][1][d];
+					home += density[c][x][y][2][d];
+
+					nextDensity[c][x][y][0][d] = 0;
+					nextDensity[c][x][y][1][d] = 0;
+					nextDensity[c][x][y][2][d] = 0;
+				}
+
+				if (search > 0) {
+					pheromone[x][y][2 * sp] += param.pheromoneReleaseOne * search;
+				}
+				if (home > 0) {
+					pheromone[x][y][2 * sp + 1] += param.pheromoneReleaseTwo * home;
+				}
+			}
 		}
+
+		meanFieldRespawn[c] = 0;
 	}
 
-	/* Left down */
-	if (antList[a_n].x - 1 >= 0 && antList[a_n].y + 1 <= L_MAX * 2) {
-		if (pheromone[antList[a_n].x - 1][antList[a_n].y + 1][pheromone_num] >= antList[a_n].threshold[pheromone_num]) {
-			return 1;				
-		}	
+	/* move */
+	for (c = 0; c < COLONY_NUM; c++) {
+		sp = colonyList[c].species;
+
+		for (x = 0; x <= L_MAX * 2; x++) {
+			for (y = 0; y <= L_MAX * 2; y++) {
+				mask = passableMask[x][y];
+
+				for (m = 0; m < 3; m++) {
+					sum = 0;
+					for (d = 0; d < 6; d++) {
+						sum += density[c][x][y][m][d];
+					}
+					if (sum <= 0) {
+						continue;
+					}
+
+					/* mode 2 follows pheromone two, mode 3 follows pheromone one */
+					if (m > 0) {
+						surroundingPheromoneAt (x, y, 2 * sp + (m == 1 ? 1 : 0), surroundingPheromone);
+						calculateWeight (surroundingPheromone, weight);
+					}
+
+					for (d = 0; d < 6; d++) {
+						mass = density[c][x][y][m][d];
+						if (mass <= 0) {
+							continue;
+						}
+
+						cone[0] = (d + 5) % 6;
+						cone[1] = d;
+						cone[2] = (d + 1) % 6;
+
+						if (m == 0) {
+							p[0] = p[1] = p[2] = 1 / 3.0;
+						}
+						else {
+							sum = (double) weight[cone[0]] + weight[cone[1]] + weight[cone[2]];
+							for (k = 0; k < 3; k++) {
+								p[k] = weight[cone[k]] / sum;
+							}
+						}
+
+						/* multinomial split as a chain of binomials */
+						part[0] = meanFieldSample (mass, p[0]);
+						part[1] = p[0] < 1 ? meanFieldSample (mass - part[0], p[1] / (1 - p[0])) : 0;
+						part[2] = mass - part[0] - part[1];
+
+						for (k = 0; k < 3; k++) {
+							nd = cone[k];
+							canMove = (mask >> nd) & 1;
+							meanFieldEvent[EVENT_WALL] += (1 - canMove) * part[k];
+							meanFieldArrive (c, x + canMove * directionX[nd], y + canMove * directionY[nd], m, nd, part[k]);
+						}
+					}
+				}
+			}
+		}
 	}
 
-	/* Left up */
-	if (antList[a_n].x - 1 >= 0) {
-		if (pheromone[antList[a_n].x - 1][antList[a_n].y][pheromone_num] >= antList[a_n].threshold[pheromone_num]) {
-			return 1;		
+	/* swap and bring expired or returned ants back as mode 1 */
+	for (c = 0; c < COLONY_NUM; c++) {
+		for (x = 0; x <= L_MAX * 2; x++) {
+			for (y = 0; y <= L_MAX * 2; y++) {
+				for (m = 0; m < 3; m++) {
+					for (d = 0; d < 6; d++) {
+						density[c][x][y][m][d] = nextDensity[c][x][y][m][d];
+					}
+				}
+			}
 		}
+
+		meanFieldTotal[c] += meanFieldRespawn[c];
+		meanFieldSpread (c, colonyList[c].nestX, colonyList[c].nestY, meanFieldRespawn[c]);
 	}
+}
 
-	return 0;
+/* Mode changes of ants that have just arrived at (x, y), as in movementOne ~ Three */
+void meanFieldArrive (int c, int x, int y, int m, int d, double mass) {
+	int i, sp;
+	double expired, over, q, maxAround = 0;
+
+	if (mass <= 0) {
+		return;
+	}
+
+	/* homing */
+	if (m == 2) {
+		if (x == colonyList[c].nestX && y == colonyList[c].nestY) {
+			meanFieldComeBack[c] += mass;
+			meanFieldRespawn[c] += mass;
+			meanFieldEvent[EVENT_RETURN] += mass;
+			return;
+		}
+
+		expired = meanFieldSample (mass, 1.0 / N);
+		meanFieldRespawn[c] += expired;
+		nextDensity[c][x][y][2][d] += mass - expired;
+		return;
+	}
+
+	/* vitality runs out with rate 1 / N, which makes an ant homing */
+	expired = meanFieldSample (mass, 1.0 / N);
+	meanFieldRespawn[c] += expired;
+	meanFieldEvent[EVENT_MODE_CHANGE] += expired;
+	mass -= expired;
+
+	if (foodPlace[x][y] == 1) {
+		nextDensity[c][x][y][2][d] += mass;
+		meanFieldEvent[EVENT_FOOD] += mass;
+		meanFieldEvent[EVENT_MODE_CHANGE] += mass;
+		return;
+	}
+
+	/* checkPheromone on pheromone two, half of ants are sensitive */
+	sp = colonyList[c].species;
+	for (i = 0; i < 6; i++) {
+		if ((passableMask[x][y] >> i) & 1) {
+			maxAround = fmax (maxAround, pheromone[x + directionX[i]][y + directionY[i]][2 * sp + 1]);
+		}
+	}
+
+	q = 0;
+	if (maxAround >= (int) param.thresholdTwoSensitive) {
+		q += 0.5;
+	}
+	if (maxAround >= (int) param.thresholdTwoInsensitive) {
+		q += 0.5;
+	}
+
+	over = meanFieldSample (mass, q);
+	nextDensity[c][x][y][0][d] += mass - over;
+	nextDensity[c][x][y][1][d] += over;
+	meanFieldEvent[EVENT_MODE_CHANGE] += m == 0 ? over : mass - over;
+}
+
+/* Puts mode 1 ants at (x, y), facing every direction equally */
+void meanFieldSpread (int c, int x, int y, double mass) {
+	int d;
+	double part;
+
+	for (d = 0; d < 6; d++) {
+		part = meanFieldSample (mass, 1.0 / (6 - d));
+		density[c][x][y][0][d] += part;
+		mass -= part;
+	}
+}
+
+/* Expectation or a binomial sample, depending on MEAN_FIELD_MODE */
+double meanFieldSample (double mass, double p) {
+	if (MEAN_FIELD_MODE == 0) {
+		return mass * p;
+	}
+	return binomialSample (mass, p);
+}
+
+/* Binomial (n, p), normal approximation for large n */
+double binomialSample (double n, double p) {
+	int i;
+	double k = 0;
+	double mean, sd, u, v;
+
+	if (p <= 0 || n <= 0) {
+		return 0;
+	}
+	if (p >= 1) {
+		return n;
+	}
+
+	if (n < 64) {
+		for (i = 0; i < (int) n; i++) {
+			if (randomNext () / (RANDOM_MAX + 1.0) < p) {
+				k++;
+			}
+		}
+		return k;
+	}
+
+	mean = n * p;
+	sd = sqrt (n * p * (1 - p));
+	u = (randomNext () + 1.0) / (RANDOM_MAX + 2.0);
+	v = randomNext () / (RANDOM_MAX + 1.0);
+	k = floor (mean + sd * sqrt (-2 * log (u)) * cos (2 * M_PI * v) + 0.5);
+
+	return fmin (n, fmax (0, k));
+}
+
+/* Mode ratio from densities */
+void meanFieldRatio () {
+	int c, x, y, m, d;
+	double sum[3] = {0, 0, 0};
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		for (x = 0; x <= L_MAX * 2; x++) {
+			for (y = 0; y <= L_MAX * 2; y++) {
+				for (m = 0; m < 3; m++) {
+					for (d = 0; d < 6; d++) {
+						sum[m] += density[c][x][y][m][d];
+					}
+				}
+			}
+		}
+	}
+
+	for (m = 0; m < 3; m++) {
+		ratio[m] = (int) (sum[m] + 0.5);
+	}
 }
 
 /* ------------------------- PHEROMONE BEHAVIOR -------------------------- */
 
 /* Pheromone chage according to time */
 void pheromoneBehavior () {
+	long long start = profileBegin ();
+
 	pheromoneDiffusion ();
+	profileEnd (PHASE_DIFFUSION, start);
+
+	start = profileBegin ();
 	pheormoneEvaporation ();
+	profileEnd (PHASE_EVAPORATION, start);
 }
 
 /* Pheromone diffusion */
 void pheromoneDiffusion () {
-	int px, py;
-	double tempDiffOne, tempDiffTwo;
+	int px, py, d, mask, k;
+	double tempDiffOne[SPECIES_NUM], tempDiffTwo[SPECIES_NUM];
 
 	/* Store pheromone that will diffuse */
+	for (k = 0; k < SPECIES_NUM; k++) {
+		tempDiffOne[k] = 0;
+		tempDiffTwo[k] = 0;
+
+		for (px = 0; px <= L_MAX * 2; px++) {
+			for (py = 0; py <= L_MAX * 2; py++) {
+				if (pheromone[px][py][2 * k] > 0) {
+					tempDiffOne[k] = pheromone[px][py][2 * k] * param.diffusionCoefOne;
+					tempDiffTwo[k] = pheromone[px][py][2 * k + 1] * param.diffusionCoefTwo;
+
+					mask = passableMask[px][py];
+
+					for (d = 0; d < 6; d++) {
+						if ((mask >> d) & 1) {
+							tempPheromone[px + directionX[d]][py + directionY[d]][2 * k] += tempDiffOne[k];
+							tempPheromone[px + directionX[d]][py + directionY[d]][2 * k + 1] += tempDiffTwo[k];
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	/* Diffusion */
+	for (k = 0; k < SPECIES_NUM; k++) {
+		for (px = 0; px <= L_MAX * 2; px++) {
+			for (py = 0; py <= L_MAX * 2; py++) {
+				if (tempPheromone[px][py][2 * k] > 0) {
+					pheromone[px][py][2 * k] -= 6 * tempDiffOne[k];
+					pheromone[px][py][2 * k + 1] -= 6 * tempDiffTwo[k];
+
+					pheromone[px][py][2 * k] += tempPheromone[px][py][2 * k];
+					pheromone[px][py][2 * k + 1] += tempPheromone[px][py][2 * k + 1];
+				}
+			}
+		}
+	}
+}
+
+/* Pheromone evaporation, reducing fieldStats on the way */
+void pheormoneEvaporation () {
+	int px, py, k;
+	double v;
+
+	memset (fieldStats, 0, sizeof (fieldStats));
+
 	for (px = 0; px <= L_MAX * 2; px++) {
 		for (py = 0; py <= L_MAX * 2; py++) {
-			if (pheromone[px][py][0] > 0) {
-				tempDiffOne = pheromone[px][py][0] * DIFFUSION_COEF_ONE;
-				tempDiffTwo = pheromone[px][py][1] * DIFFUSION_COEF_TWO;
-
-				/* Up */
-				if (px - 1 >= 0) {
-					if (tempPheromone[px - 1][py][0] >= 0) {
-						tempPheromone[px - 1][py][0] += tempDiffOne;
-						tempPheromone[px - 1][py][1] += tempDiffTwo;
-					}
+			for (k = 0; k < SPECIES_NUM; k++) {
+				if (pheromone[px][py][2 * k] > 0) {
+					pheromone[px][py][2 * k] *= param.evaporateCoefOne;
+					pheromone[px][py][2 * k + 1] *= param.evaporateCoefTwo;
 				}
-				/* Right up */
-				if (px - 1 >= 0 && py + 1 <= L_MAX * 2) {
-					if (tempPheromone[px - 1][py + 1][0] >= 0) {
-						tempPheromone[px - 1][py + 1][0] += tempDiffOne;
-						tempPheromone[px - 1][py + 1][1] += tempDiffTwo;
-					}
+			}
+			for (k = 0; k < 2 * SPECIES_NUM; k++) {
+				if ((v = pheromone[px][py][k]) > 0) {
+					fieldStats[k].max = fmax (fieldStats[k].max, v);
+					fieldStats[k].sum += v;
+					fieldStats[k].nonzero++;
 				}
-				/* Right down */
-				if (py + 1 <= L_MAX * 2) {
-					if (tempPheromone[px][py + 1][0] >= 0) {
-						tempPheromone[px][py + 1][0] += tempDiffOne;
-						tempPheromone[px][py + 1][1] += tempDiffTwo;
-					}
+			}
+		}
+	}
+	fieldVersion++;
+}
+
+/* Recomputes fieldStats after the field was set from outside a step */
+/* and rebuilds the pyramid, since obstacles may have changed as well */
+void fieldStatUpdate () {
+	int px, py, k;
+	double v;
+
+	memset (fieldStats, 0, sizeof (fieldStats));
+
+	for (px = 0; px <= L_MAX * 2; px++) {
+		for (py = 0; py <= L_MAX * 2; py++) {
+			for (k = 0; k < 2 * SPECIES_NUM; k++) {
+				if ((v = pheromone[px][py][k]) > 0) {
+					fieldStats[k].max = fmax (fieldStats[k].max, v);
+					fieldStats[k].sum += v;
+					fieldStats[k].nonzero++;
 				}
-				/* Left down */
-				if (px + 1 <= L_MAX * 2) {
-					if (tempPheromone[px + 1][py][0] >= 0) {
-						tempPheromone[px + 1][py][0] += tempDiffOne;
-						tempPheromone[px + 1][py][1] += tempDiffTwo;
-					}
+			}
+		}
+	}
+	fieldVersion++;
+
+	pyramidInitialization ();
+}
+
+/* ----------------------------- PYRAMID --------------------------------- */
+
+/* Lays the levels out and counts open cells per block */
+void pyramidInitialization () {
+	int l, bx, by, px, py;
+
+	pyramidSide[0] = PYRAMID_WIDTH;
+	pyramidOffset[0] = 0;
+	for (l = 1; pyramidSide[l - 1] > 1 && l < PYRAMID_LEVEL_MAX; l++) {
+		pyramidSide[l] = (pyramidSide[l - 1] + 1) / 2;
+		pyramidOffset[l] = pyramidOffset[l - 1] + pyramidSide[l - 1] * pyramidSide[l - 1];
+	}
+	pyramidLevels = l;
+
+	memset (pyramidOpen, 0, sizeof (int) * PYRAMID_BLOCKS);
+	for (px = 0; px <= L_MAX * 2; px++) {
+		for (py = 0; py <= L_MAX * 2; py++) {
+			if (isOpenCell (px, py)) {
+				bx = px / PYRAMID_TILE;
+				by = py / PYRAMID_TILE;
+				for (l = 0; l < pyramidLevels; l++) {
+					pyramidOpen[pyramidOffset[l] + bx * pyramidSide[l] + by]++;
+					bx /= 2;
+					by /= 2;
 				}
-				/* Left up */
-				if (px + 1 <= L_MAX * 2 && py - 1 >= 0) {
-					if (tempPheromone[px + 1][py - 1][0] >= 0) {
-						tempPheromone[px + 1][py - 1][0] += tempDiffOne;
-						tempPheromone[px + 1][py - 1][1] += tempDiffTwo;
+			}
+		}
+	}
+
+	pyramidVersion = -1;
+}
+
+/* Rebuilds the pyramid from the field; nothing to do if the field is unchanged */
+void pyramidRefresh () {
+	int l, k, b, bx, by, cx, cy, px, py;
+	pyramidBlock *block, *child;
+	double v;
+
+	if (pyramidVersion == fieldVersion) {
+		return;
+	}
+
+	/* tiles from cells */
+	for (bx = 0; bx < PYRAMID_WIDTH; bx++) {
+		for (by = 0; by < PYRAMID_WIDTH; by++) {
+			b = bx * PYRAMID_WIDTH + by;
+
+			for (k = 0; k < 2 * SPECIES_NUM; k++) {
+				block = &pyramid[k][b];
+				block->sum = 0;
+				block->max = 0;
+				block->cells = pyramidOpen[b];
+
+				for (px = bx * PYRAMID_TILE; px < (bx + 1) * PYRAMID_TILE && px <= L_MAX * 2; px++) {
+					for (py = by * PYRAMID_TILE; py < (by + 1) * PYRAMID_TILE && py <= L_MAX * 2; py++) {
+						if ((v = pheromone[px][py][k]) > 0) {
+							block->sum += v;
+							block->max = fmax (block->max, v);
+						}
 					}
 				}
-				/* Down */
-				if (py - 1 >= 0) {
-					if (tempPheromone[px][py - 1][0] >= 0) {
-						tempPheromone[px][py - 1][0] += tempDiffOne;
-						tempPheromone[px][py - 1][1] += tempDiffTwo;
+			}
+		}
+	}
+
+	/* each level above from the 2 x 2 blocks below it */
+	for (l = 1; l < pyramidLevels; l++) {
+		for (bx = 0; bx < pyramidSide[l]; bx++) {
+			for (by = 0; by < pyramidSide[l]; by++) {
+				b = pyramidOffset[l] + bx * pyramidSide[l] + by;
+
+				for (k = 0; k < 2 * SPECIES_NUM; k++) {
+					block = &pyramid[k][b];
+					block->sum = 0;
+					block->max = 0;
+					block->cells = pyramidOpen[b];
+
+					for (cx = 2 * bx; cx < 2 * bx + 2 && cx < pyramidSide[l - 1]; cx++) {
+						for (cy = 2 * by; cy < 2 * by + 2 && cy < pyramidSide[l - 1]; cy++) {
+							child = &pyramid[k][pyramidOffset[l - 1] + cx * pyramidSide[l - 1] + cy];
+							block->sum += child->sum;
+							block->max = fmax (block->max, child->max);
+						}
 					}
 				}
 			}
 		}
 	}
-	
-	/* Diffusion */
-	for (px = 0; px <= L_MAX * 2; px++) {
-		for (py = 0; py <= L_MAX * 2; py++) {
-			if (tempPheromone[px][py][0] > 0) {
-				pheromone[px][py][0] -= 6 * tempDiffOne;
-				pheromone[px][py][1] -= 6 * tempDiffTwo;
 
-				pheromone[px][py][0] += tempPheromone[px][py][0];
-				pheromone[px][py][1] += tempPheromone[px][py][1];
+	pyramidVersion = fieldVersion;
+}
+
+/* Coarsest level that still has at least side blocks across */
+int pyramidLevelFor (int side) {
+	int l = pyramidLevels - 1;
+
+	while (l > 0 && pyramidSide[l] < side) {
+		l--;
+	}
+	return l;
+}
+
+/* Sum, max and open cells of plane k over cells x0 ~ x1, y0 ~ y1 */
+void pyramidRegion (int k, int x0, int y0, int x1, int y1, pyramidBlock *out) {
+	out->sum = 0;
+	out->max = 0;
+	out->cells = 0;
+
+	pyramidRefresh ();
+	pyramidRegionAt (k, pyramidLevels - 1, 0, 0, x0, y0, x1, y1, out);
+}
+
+/* Takes whole blocks inside the region, splits the ones on its border */
+void pyramidRegionAt (int k, int level, int bx, int by, int x0, int y0, int x1, int y1, pyramidBlock *out) {
+	int size = PYRAMID_TILE << level;
+	int bx0 = bx * size, by0 = by * size;
+	int bx1 = bx0 + size - 1, by1 = by0 + size - 1;
+	pyramidBlock *block;
+	int px, py, cx, cy;
+
+	if (bx >= pyramidSide[level] || by >= pyramidSide[level] || bx0 > x1 || by0 > y1 || bx1 < x0 || by1 < y0) {
+		return;
+	}
+
+	if (x0 <= bx0 && bx1 <= x1 && y0 <= by0 && by1 <= y1) {
+		block = &pyramid[k][pyramidOffset[level] + bx * pyramidSide[level] + by];
+		out->sum += block->sum;
+		out->max = fmax (out->max, block->max);
+		out->cells += block->cells;
+		return;
+	}
+
+	if (level > 0) {
+		for (cx = 2 * bx; cx < 2 * bx + 2; cx++) {
+			for (cy = 2 * by; cy < 2 * by + 2; cy++) {
+				pyramidRegionAt (k, level - 1, cx, cy, x0, y0, x1, y1, out);
 			}
 		}
+		return;
 	}
-}
 
-/* Pheromone evaporation */
-void pheormoneEvaporation () {
-	int px, py;
+	for (px = fmax (bx0, x0); px <= bx1 && px <= x1 && px <= L_MAX * 2; px++) {
+		for (py = fmax (by0, y0); py <= by1 && py <= y1 && py <= L_MAX * 2; py++) {
+			if (isOpenCell (px, py)) {
+				out->cells++;
+				if (pheromone[px][py][k] > 0) {
+					out->sum += pheromone[px][py][k];
+					out->max = fmax (out->max, pheromone[px][py][k]);
+				}
+			}
+		}
+	}
+}
 
-	for (px = 0; px <= L_MAX * 2; px++) {
-		for (py = 0; py <= L_MAX * 2; py++) {
-			if (pheromone[px][py][0] > 0) {
-				pheromone[px][py][0] *= EVAPORATE_COEF_ONE;
-				pheromone[px][py][1] *= EVAPORATE_COEF_TWO;
+/* side x side means of plane k, in grid (not hex) layout, from the coarsest level that fits */
+/* a pixel averages the open cells of every block it covers */
+void pyramidThumbnail (int k, int side, float *out) {
+	int level, u, v, bx, by, n;
+	pyramidBlock *block;
+	double sum;
+	int cells;
+
+	pyramidRefresh ();
+	level = pyramidLevelFor (side);
+	n = pyramidSide[level];
+
+	for (u = 0; u < side; u++) {
+		for (v = 0; v < side; v++) {
+			sum = 0;
+			cells = 0;
+
+			/* at least one block, even when there are fewer blocks than pixels */
+			for (bx = u * n / side; bx == u * n / side || bx < (u + 1) * n / side; bx++) {
+				for (by = v * n / side; by == v * n / side || by < (v + 1) * n / side; by++) {
+					block = &pyramid[k][pyramidOffset[level] + bx * n + by];
+					sum += block->sum;
+					cells += block->cells;
+				}
 			}
+			out[u * side + v] = cells > 0 ? sum / cells : 0;
 		}
 	}
 }
 
-/* ---------------------------- FILE OUTPUT ------------------------------ */
+/* ---------------------------- CONVERGENCE ------------------------------ */
 
-/* creates file with current time */
-void createAndWriteInFile () {
-	char fileName[20];
-	FILE *fp;
-	int t;
+/* Called after t steps, 1 means the run has settled and stops at t */
+int convergeCheck (int t) {
+	int window = (int) param.convergeWindow;
+	double homing, field;
 
-	sprintf (fileName, "%d.csv", seed);
+	if (window <= 0 || t % window != 0) {
+		return 0;
+	}
 
-	if ((fp = fopen (fileName, "w")) == NULL) {
-		printf ("FAILED TO CREATE FILE");
+	homing = totalComeBack () / (double) totalAntCount ();
+	field = pheromoneTotal ();
+
+	if (t > window && fabs (homing - convergeLastHoming) <= param.convergeTolerance && fabs (field - convergeLastField) <= param.convergeFieldTolerance * fabs (convergeLastField)) {
+		convergeStable++;
+	}
+	else {
+		convergeStable = 0;
+	}
+	convergeLastHoming = homing;
+	convergeLastField = field;
+
+	if (convergeStable < (int) param.convergePatience) {
+		return 0;
 	}
 
-	fprintf (fp, "L_MAX,ANT_NUM,N,FOOD_NUM,SURROUNDING_MODE,MAX_PROCEDURE,LUG,THRESHOLD_TWO_SENSITIVE,THRESHOLD_TWO_INSENSITIVE,PHEROMONE_RELEASE_ONE,PHEROMONE_RELEASE_TWO,INCREMENT,DIFFUSION_COEF_ONE,EVAPORATE_COEF_ONE,DIFFUSION_COEF_TWO,EVAPORATE_COEF_TWO\n");
-	fprintf (fp, "%d,%d,%d,%d,%d,%d,%lf,%lf,%lf,%lf,%lf,%d,%lf,%lf,%lf,%lf\n", L_MAX, ANT_NUM, N,FOOD_NUM, SURROUNDING_MODE, MAX_PROCEDURE, LUG, THRESHOLD_TWO_SENSITIVE, THRESHOLD_TWO_INSENSITIVE, PHEROMONE_RELEASE_ONE, PHEROMONE_RELEASE_TWO, INCREMENT, DIFFUSION_COEF_ONE, EVAPORATE_COEF_ONE, DIFFUSION_COEF_TWO,  EVAPORATE_COEF_TWO);
+	stopStep = t;
+	stopReason = STOP_CONVERGED;
+	if (isQuiet == 0) {
+		printf ("CONVERGED AT %d\n", t);
+	}
+	return 1;
+}
+
+/* Sum of every pheromone plane over open cells */
+double pheromoneTotal () {
+	double sum = 0;
+	int k;
+
+	for (k = 0; k < 2 * SPECIES_NUM; k++) {
+		sum += fieldStats[k].sum;
+	}
+	return sum;
+}
+
+/* ------------------------------- ARENA --------------------------------- */
+
+/* Maps the world once; ANTS_HUGEPAGES=0/1/2 overrides ARENA_PAGES */
+void arenaInitialization () {
+	char *env = getenv ("ANTS_HUGEPAGES");
+	size_t size = 0;
+	char *map = MAP_FAILED;
+	int i;
+
+	/* every grid and the ants, as pointer and size */
+# define ARENA_BLOCK(a, count) {(void **) &(a), sizeof (*(a)) * (count)}
+	struct {
+		void **pointer;
+		size_t size;
+	} block[] = {
+		ARENA_BLOCK (pheromone, L_MAX * 2 + 1),
+		ARENA_BLOCK (tempPheromone, L_MAX * 2 + 1),
+		ARENA_BLOCK (passableMask, L_MAX * 2 + 1),
+		ARENA_BLOCK (obstaclePlace, L_MAX * 2 + 1),
+		ARENA_BLOCK (antList, ANT_NUM),
+		ARENA_BLOCK (coordinate, L_MAX * 2 + 1),
+		ARENA_BLOCK (normalizedPheromone, L_MAX * 2 + 1),
+		ARENA_BLOCK (pyramid, 2 * SPECIES_NUM),
+		ARENA_BLOCK (pyramidOpen, PYRAMID_BLOCKS),
+		ARENA_BLOCK (foodPlace, L_MAX * 2 + 1),
+		ARENA_BLOCK (density, ENGINE == 1 ? COLONY_NUM : 0),
+		ARENA_BLOCK (nextDensity, ENGINE == 1 ? COLONY_NUM : 0),
+	};
+# undef ARENA_BLOCK
+
+	if (worldArena.base != NULL) {
+		return;
+	}
 
-	for (t = 0; t < MAX_PROCEDURE; t++) {
-		fprintf (fp, "%d,%lf, %d", t, homingProb[t], homingNum[t]);
+	worldArena.pages = env != NULL ? atoi (env) : ARENA_PAGES;
+	worldArena.pages = worldArena.pages < 0 ? 0 : worldArena.pages > 2 ? 2 : worldArena.pages;
+	for (i = 0; i < (int) (sizeof (block) / sizeof (block[0])); i++) {
+		size += (block[i].size + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+	}
+	if (worldArena.pages > 0) {
+		size = (size + ARENA_HUGE_PAGE - 1) / ARENA_HUGE_PAGE * ARENA_HUGE_PAGE;
+	}
 
-		if (t < 7 * FOOD_NUM) {
-			fprintf (fp, ",%d,%d", foodPos[t][0], foodPos[t][1]);
+# ifdef MAP_HUGETLB
+	if (worldArena.pages == 2) {
+		map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	}
+# endif
+	if (map == MAP_FAILED) {
+		worldArena.pages = worldArena.pages > 0;
+		/* one extra huge page, so the start can be moved to a huge page boundary */
+		map = mmap (NULL, size + (worldArena.pages ? ARENA_HUGE_PAGE : 0), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (map == MAP_FAILED) {
+			printf ("FAILED TO MAP WORLD (%zu BYTES)\n", size);
+			exit (1);
 		}
+		if (worldArena.pages) {
+			map += (ARENA_HUGE_PAGE - (size_t) map % ARENA_HUGE_PAGE) % ARENA_HUGE_PAGE;
+# ifdef MADV_HUGEPAGE
+			if (madvise (map, size, MADV_HUGEPAGE) != 0) {
+				worldArena.pages = 0;
+			}
+# else
+			worldArena.pages = 0;
+# endif
+		}
+	}
 
-		fprintf (fp, "\n");
+	worldArena.base = map;
+	worldArena.size = size;
+	for (i = 0; i < (int) (sizeof (block) / sizeof (block[0])); i++) {
+		*block[i].pointer = block[i].size > 0 ? arenaTake (block[i].size) : NULL;
 	}
+}
 
-	fclose (fp);
+/* Next ARENA_ALIGN aligned block, zeroed since the mapping is new */
+void *arenaTake (size_t bytes) {
+	void *p = worldArena.base + worldArena.used;
+
+	worldArena.used += (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+	worldArena.blocks++;
+	if (worldArena.used > worldArena.size) {
+		printf ("WORLD ARENA IS FULL\n");
+		exit (1);
+	}
+	return p;
 }
 
+/* A run starts on the world the last one left */
+void arenaRunStart () {
+	worldArena.runs++;
+	worldArena.faults = arenaFaults ();
+}
 
-/* ----------------------------- TEST ------------------------------------ */
-/* Checking if honeycomb is properly generated */
-void graphicTest () {
-	int i, j;
+/* Minor page faults of this process so far */
+long arenaFaults () {
+	struct rusage usage;
 
-	g_def_scale(1, -L_MAX - 1, L_MAX + 1, - L_MAX - 1, L_MAX + 1, 0, 0, 100.0, 100.0);
-	g_marker_type(1);
-	g_marker_color(0);
+	getrusage (RUSAGE_SELF, &usage);
+	return usage.ru_minflt;
+}
 
-	g_sel_scale(1);
+/* Bytes of the arena backed by huge pages, from /proc/self/smaps; -1 if unknown */
+long arenaHugeBytes () {
+	FILE *fp = fopen ("/proc/self/smaps", "r");
+	char line[256];
+	unsigned long start, end;
+	long kb, sum = -1;
+	int isArena = 0;
 
-	for (i = 0; i < L_MAX * 2 + 1; i++) {
-		for (j = 0; j < L_MAX * 2 + 1; j++) {
-			g_marker (coordinate[i][j][0], coordinate[i][j][1]);
+	if (fp == NULL) {
+		return -1;
+	}
+	while (fgets (line, sizeof (line), fp) != NULL) {
+		if (sscanf (line, "%lx-%lx ", &start, &end) == 2) {
+			isArena = start <= (unsigned long) worldArena.base && (unsigned long) worldArena.base < end;
+		}
+		else if (isArena && (sscanf (line, "AnonHugePages: %ld kB", &kb) == 1 || sscanf (line, "Private_Hugetlb: %ld kB", &kb) == 1)) {
+			sum = (sum < 0 ? 0 : sum) + kb * 1024;
 		}
 	}
+	fclose (fp);
+
+	return sum;
 }
 
-void structAntTest (int a_n) {
-	printf("%d, %d", antList[a_n].x, antList[a_n].y);
+/* Printed with the profile summary */
+void arenaSummary () {
+	long huge = arenaHugeBytes ();
+
+	printf ("ARENA\n");
+	printf ("  %.1lf / %.1lf MiB in %d blocks, %s pages", worldArena.used / 1048576.0, worldArena.size / 1048576.0, worldArena.blocks, arenaPageName[worldArena.pages]);
+	if (huge >= 0) {
+		printf (", %.1lf MiB huge", huge / 1048576.0);
+	}
+	printf ("\n  run %d, %ld page faults\n", worldArena.runs, arenaFaults () - worldArena.faults);
+}
+
+/* ------------------------------ PROFILE -------------------------------- */
+
+/* ANTS_PROFILE=1 turns profiling on without recompiling */
+void profileInitialization () {
+	char *env = getenv ("ANTS_PROFILE");
+	char fileName[48];
+	int i;
+
+	if (env != NULL) {
+		doesProfile = atoi (env);
+	}
+
+	for (i = 0; i < PHASE_NUM; i++) {
+		phaseTime[i] = 0;
+		lastPhaseTime[i] = 0;
+	}
+	for (i = 0; i < EVENT_NUM; i++) {
+		eventCount[i] = 0;
+		lastEventCount[i] = 0;
+	}
+	lastProfileStep = 0;
+	profileSteps = 0;
+
+	if (doesProfile) {
+		sprintf (fileName, "%s.profile.jsonl", runName);
+		if ((profileFile = fopen (fileName, "w")) == NULL) {
+			printf ("FAILED TO CREATE PROFILE FILE\n");
+		}
+	}
+}
+
+/* Monotonic clock in nanoseconds */
+long long profileClock () {
+	struct timespec ts;
+
+	clock_gettime (CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* Starts timing a phase, nothing but a branch when profiling is off */
+long long profileBegin () {
+	if (doesProfile && profileTiming && profileDepth < PROFILE_DEPTH) {
+		profileInner[profileDepth++] = 0;
+		return profileClock ();
+	}
+	return 0;
+}
+
+/* Adds time since start to a phase, less the phases timed inside it */
+void profileEnd (int phase, long long start) {
+	long long elapsed;
+
+	if (doesProfile && profileTiming && start != 0) {
+		elapsed = profileClock () - start;
+		profileDepth--;
+		phaseTime[phase] += (elapsed - profileInner[profileDepth]) * profileScale;
+		if (profileDepth > 0) {
+			profileInner[profileDepth - 1] += elapsed;
+		}
+	}
+}
+
+/* Times the ant update of step t only if it is a sampled one */
+void profileSample (int t) {
+	profileTiming = t % PROFILE_SAMPLE == 0;
+	profileScale = PROFILE_SAMPLE;
+}
+
+/* Back to timing every phase once */
+void profileSampleEnd () {
+	profileTiming = 1;
+	profileScale = 1;
+}
+
+/* Called at the end of every procedure, writes one JSON line per PROFILE_INTERVAL */
+void profileStep (int t) {
+	int i;
+	int steps;
+
+	profileSteps++;
+
+	if (doesProfile == 0 || profileFile == NULL || (t + 1) % PROFILE_INTERVAL != 0) {
+		return;
+	}
+
+	steps = t + 1 - lastProfileStep;
+
+	fprintf (profileFile, "{\"step\":%d,\"steps\":%d,\"ns\":{", t, steps);
+	for (i = 0; i < PHASE_NUM; i++) {
+		fprintf (profileFile, "%s\"%s\":%lld", i == 0 ? "" : ",", phaseName[i], phaseTime[i] - lastPhaseTime[i]);
+		lastPhaseTime[i] = phaseTime[i];
+	}
+	fprintf (profileFile, "},\"events\":{");
+	for (i = 0; i < EVENT_NUM; i++) {
+		fprintf (profileFile, "%s\"%s\":%lld", i == 0 ? "" : ",", eventName[i], eventCount[i] - lastEventCount[i]);
+		lastEventCount[i] = eventCount[i];
+	}
+	fprintf (profileFile, "}}\n");
+	fflush (profileFile);
+
+	lastProfileStep = t + 1;
+}
+
+/* Summary at exit */
+void profileSummary () {
+	int i;
+	int steps = profileSteps > 0 ? profileSteps : 1;
+
+	if (doesProfile) {
+		printf ("PROFILE (%d steps)\n", profileSteps);
+		for (i = 0; i < PHASE_NUM; i++) {
+			printf ("  %-14s %14lld ns %12.1lf ns/step\n", phaseName[i], phaseTime[i], phaseTime[i] / (double) steps);
+		}
+	}
+
+	printf ("EVENTS\n");
+	for (i = 0; i < EVENT_NUM; i++) {
+		printf ("  %-14s %14lld\n", eventName[i], eventCount[i]);
+	}
+
+	arenaSummary ();
+
+	if (profileFile != NULL) {
+		fclose (profileFile);
+		profileFile = NULL;
+	}
+}
+
+/* ---------------------------- FILE OUTPUT ------------------------------ */
+
+/* Exports this run's time series as <seed>.csv */
+void createAndWriteInFile () {
+	char fileName[48];
+
+	seriesClose ();
+
+	if (WRITE_CSV == 0 || doesWrite == 0) {
+		return;
+	}
+
+	sprintf (fileName, "%s.csv", runName);
+
+	if (seriesExportCsv (seriesFileName, fileName) == 0) {
+		printf ("FAILED TO CREATE FILE");
+	}
+}
+
+/* Opens <run>.series and writes the header describing the run */
+void seriesInitialization () {
+	seriesRows = 0;
+	sprintf (seriesFileName, "%s.series", runName);
+
+	if (doesWrite == 0) {
+		return;
+	}
+
+	if ((seriesFile = fopen (seriesFileName, "wb")) == NULL) {
+		printf ("FAILED TO CREATE FILE");
+		return;
+	}
+
+	seriesWriteHeader (seriesFile);
+	fflush (seriesFile);
+}
+
+/* Header, food positions and column names with the parameters in use */
+void seriesWriteHeader (FILE *fp) {
+	seriesHeader header;
+	char name[16];
+	int c;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, "ANTS", 4);
+	header.version = SERIES_VERSION;
+	header.seed = seed;
+	header.lMax = L_MAX;
+	header.antNum = ANT_NUM;
+	header.vitality = N;
+	header.foodNum = FOOD_NUM;
+	header.surroundingMode = SURROUNDING_MODE;
+	header.maxProcedure = MAX_PROCEDURE;
+	header.increment = INCREMENT;
+	header.colonyNum = COLONY_NUM;
+	header.foodCount = SURROUNDING_MODE == 0 ? FOOD_NUM : FOOD_NUM * 7;
+	header.columnCount = SERIES_COLUMN;
+	header.blockRows = SERIES_BUFFER;
+	header.engine = ENGINE;
+	header.lug = LUG;
+	header.thresholdOneSensitive = param.thresholdOneSensitive;
+	header.thresholdOneInsensitive = param.thresholdOneInsensitive;
+	header.thresholdTwoSensitive = param.thresholdTwoSensitive;
+	header.thresholdTwoInsensitive = param.thresholdTwoInsensitive;
+	header.pheromoneReleaseOne = param.pheromoneReleaseOne;
+	header.pheromoneReleaseTwo = param.pheromoneReleaseTwo;
+	header.diffusionCoefOne = param.diffusionCoefOne;
+	header.evaporateCoefOne = param.evaporateCoefOne;
+	header.diffusionCoefTwo = param.diffusionCoefTwo;
+	header.evaporateCoefTwo = param.evaporateCoefTwo;
+	header.stopStep = stopStep;
+	header.stopReason = stopReason;
+
+	fwrite (&header, sizeof (header), 1, fp);
+	fwrite (foodPos, sizeof (foodPos[0]), header.foodCount, fp);
+
+	memset (name, 0, sizeof (name));
+	strcpy (name, "t");
+	fwrite (name, sizeof (name), 1, fp);
+	for (c = 0; c < COLONY_NUM; c++) {
+		memset (name, 0, sizeof (name));
+		sprintf (name, "homingProb%d", c);
+		fwrite (name, sizeof (name), 1, fp);
+
+		memset (name, 0, sizeof (name));
+		sprintf (name, "homingNum%d", c);
+		fwrite (name, sizeof (name), 1, fp);
+
+		memset (name, 0, sizeof (name));
+		sprintf (name, "totalAnt%d", c);
+		fwrite (name, sizeof (name), 1, fp);
+	}
+}
+
+/* Goes on in <run>.series from a copy of the parent's file, with this run's header */
+void seriesBranch (const char *parentName) {
+	FILE *in;
+	char buffer[4096];
+	size_t n;
+
+	fclose (seriesFile);
+	seriesFile = NULL;
+	sprintf (seriesFileName, "%s.series", runName);
+
+	if ((in = fopen (parentName, "rb")) == NULL || (seriesFile = fopen (seriesFileName, "wb")) == NULL) {
+		printf ("FAILED TO CREATE FILE");
+		if (in != NULL) {
+			fclose (in);
+		}
+		return;
+	}
+
+	seriesWriteHeader (seriesFile);
+	fseek (in, ftell (seriesFile), SEEK_SET);
+	while ((n = fread (buffer, 1, sizeof (buffer), in)) > 0) {
+		fwrite (buffer, 1, n, seriesFile);
+	}
+	fclose (in);
+	fflush (seriesFile);
+}
+
+/* Buffers one row, a full buffer goes to the file */
+void seriesRecord (int t) {
+	int c;
+
+	if (ensembleTrace != NULL && t % ENSEMBLE_INTERVAL == 0) {
+		ensembleTrace[t / ENSEMBLE_INTERVAL] = totalComeBack () / (double) totalAntCount ();
+	}
+
+	if (seriesFile == NULL) {
+		return;
+	}
+
+	seriesStep[seriesRows] = t;
+	for (c = 0; c < COLONY_NUM; c++) {
+		seriesHomingProb[c][seriesRows] = homingProb[c];
+		seriesHomingNum[c][seriesRows] = homingNum[c];
+		seriesTotalAnt[c][seriesRows] = colonyList[c].totalAnt;
+	}
+	seriesRows++;
+
+	if (seriesRows == SERIES_BUFFER) {
+		seriesFlush ();
+	}
+}
+
+/* Appends buffered rows as one columnar block */
+void seriesFlush () {
+	int c;
+
+	if (seriesFile == NULL || seriesRows == 0) {
+		return;
+	}
+
+	fwrite (&seriesRows, sizeof (int), 1, seriesFile);
+	fwrite (seriesStep, sizeof (int), seriesRows, seriesFile);
+	for (c = 0; c < COLONY_NUM; c++) {
+		fwrite (seriesHomingProb[c], sizeof (double), seriesRows, seriesFile);
+		fwrite (seriesHomingNum[c], sizeof (int), seriesRows, seriesFile);
+		fwrite (seriesTotalAnt[c], sizeof (int), seriesRows, seriesFile);
+	}
+	fflush (seriesFile);
+
+	seriesRows = 0;
+}
+
+/* Flushes what is left and puts when and why the run stopped in the header */
+void seriesClose () {
+	if (seriesFile == NULL) {
+		return;
+	}
+
+	seriesFlush ();
+	fseek (seriesFile, 0, SEEK_SET);
+	seriesWriteHeader (seriesFile);
+	fclose (seriesFile);
+	seriesFile = NULL;
+}
+
+/* Setting, food positions and then one row per step; a torn last block is dropped */
+/* 0 if the file is not a series or the CSV could not be written in full */
+int seriesExportCsv (const char *seriesName, const char *csvName) {
+	FILE *in, *out;
+	seriesHeader header;
+	char name[16];
+	int food[2];
+	int rows, r, c, f;
+	int *step, *num, *total;
+	double *prob;
+	size_t block;
+	int isOk = 1;
+
+	if ((in = fopen (seriesName, "rb")) == NULL) {
+		return 0;
+	}
+	if (fread (&header, sizeof (header), 1, in) != 1 || memcmp (header.magic, "ANTS", 4) != 0 || header.version != SERIES_VERSION) {
+		fclose (in);
+		return 0;
+	}
+
+	/* sizes come from the file, and every buffer below is made from them */
+	if (header.colonyNum < 1 || header.colonyNum > COLONY_NUM || header.foodCount < 0 || header.foodCount > FOOD_NUM * 7
+		|| header.columnCount != 1 + 3 * header.colonyNum || header.columnCount > SERIES_COLUMN || header.blockRows < 1) {
+		printf ("INVALID SERIES %s\n", seriesName);
+		fclose (in);
+		return 0;
+	}
+	block = header.blockRows;
+
+	if ((out = fopen (csvName, "w")) == NULL) {
+		fclose (in);
+		return 0;
+	}
+
+	fprintf (out, "L_MAX,ANT_NUM,N,FOOD_NUM,SURROUNDING_MODE,MAX_PROCEDURE,LUG,THRESHOLD_TWO_SENSITIVE,THRESHOLD_TWO_INSENSITIVE,PHEROMONE_RELEASE_ONE,PHEROMONE_RELEASE_TWO,INCREMENT,DIFFUSION_COEF_ONE,EVAPORATE_COEF_ONE,DIFFUSION_COEF_TWO,EVAPORATE_COEF_TWO,SEED,COLONY_NUM,ENGINE,STOP_STEP,STOP_REASON\n");
+	fprintf (out, "%d,%d,%d,%d,%d,%d,%lf,%lf,%lf,%lf,%lf,%d,%lf,%lf,%lf,%lf,%d,%d,%d,%d,%s\n", header.lMax, header.antNum, header.vitality, header.foodNum, header.surroundingMode, header.maxProcedure, header.lug, header.thresholdTwoSensitive, header.thresholdTwoInsensitive, header.pheromoneReleaseOne, header.pheromoneReleaseTwo, header.increment, header.diffusionCoefOne, header.evaporateCoefOne, header.diffusionCoefTwo, header.evaporateCoefTwo, header.seed, header.colonyNum, header.engine, header.stopStep, header.stopReason >= 0 && header.stopReason <= 1 ? stopReasonName[header.stopReason] : "interrupted");
+
+	fprintf (out, "food,x,y\n");
+	for (f = 0; f < header.foodCount && isOk; f++) {
+		if (fread (food, sizeof (food), 1, in) == 1) {
+			fprintf (out, "%d,%d,%d\n", f, food[0], food[1]);
+		}
+		else {
+			isOk = 0;
+		}
+	}
+
+	for (c = 0; c < header.columnCount && isOk; c++) {
+		if (fread (name, sizeof (name), 1, in) == 1) {
+			name[15] = '\0';
+			fprintf (out, "%s%s", c == 0 ? "" : ",", name);
+		}
+		else {
+			isOk = 0;
+		}
+	}
+	fprintf (out, "\n");
+
+	step = (int *) malloc (sizeof (int) * block);
+	prob = (double *) malloc (sizeof (double) * block * header.colonyNum);
+	num = (int *) malloc (sizeof (int) * block * header.colonyNum);
+	total = (int *) malloc (sizeof (int) * block * header.colonyNum);
+	if (step == NULL || prob == NULL || num == NULL || total == NULL) {
+		printf ("CANNOT ALLOCATE %d ROWS\n", header.blockRows);
+		isOk = 0;
+	}
+
+	while (isOk && fread (&rows, sizeof (int), 1, in) == 1 && rows > 0 && rows <= header.blockRows) {
+		if (fread (step, sizeof (int), rows, in) != (size_t) rows) {
+			break;
+		}
+		for (c = 0; c < header.colonyNum; c++) {
+			if (fread (prob + c * block, sizeof (double), rows, in) != (size_t) rows
+			 || fread (num + c * block, sizeof (int), rows, in) != (size_t) rows
+			 || fread (total + c * block, sizeof (int), rows, in) != (size_t) rows) {
+				rows = 0;
+				break;
+			}
+		}
+
+		for (r = 0; r < rows; r++) {
+			fprintf (out, "%d", step[r]);
+			for (c = 0; c < header.colonyNum; c++) {
+				fprintf (out, ",%lf,%d,%d", prob[c * block + r], num[c * block + r], total[c * block + r]);
+			}
+			fprintf (out, "\n");
+		}
+	}
+
+	if (ferror (in) || ferror (out)) {
+		isOk = 0;
+	}
+
+	free (step);
+	free (prob);
+	free (num);
+	free (total);
+	fclose (in);
+	if (fclose (out) != 0) {
+		isOk = 0;
+	}
+
+	return isOk;
+}
+
+/* ---------------------------- TRAJECTORY ------------------------------- */
+
+/* Opens <run>.traj, writes the world and starts the writer thread */
+void trajectoryInitialization () {
+	trajectoryHeader header;
+	unsigned char cell;
+	char fileName[48], *env = getenv ("ANTS_TRAJECTORY");
+	int a_n, c, i, j;
+
+	if (env != NULL) {
+		doesTrajectory = atoi (env);
+	}
+	if (doesTrajectory == 0 || doesWrite == 0 || ENGINE != 0) {
+		return;
+	}
+
+	sprintf (fileName, "%s.traj", runName);
+	if ((trajectoryFile = fopen (fileName, "wb")) == NULL) {
+		printf ("FAILED TO CREATE TRAJECTORY FILE\n");
+		return;
+	}
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, "ATRJ", 4);
+	header.version = TRAJECTORY_VERSION;
+	header.seed = seed;
+	header.lMax = L_MAX;
+	header.antNum = ANT_NUM;
+	header.colonyNum = COLONY_NUM;
+	header.maxProcedure = MAX_PROCEDURE;
+	header.foodCount = SURROUNDING_MODE == 0 ? FOOD_NUM : FOOD_NUM * 7;
+
+	fwrite (&header, sizeof (header), 1, trajectoryFile);
+	for (c = 0; c < COLONY_NUM; c++) {
+		fwrite (&colonyList[c].nestX, sizeof (int), 1, trajectoryFile);
+		fwrite (&colonyList[c].nestY, sizeof (int), 1, trajectoryFile);
+		fwrite (&colonyList[c].first, sizeof (int), 1, trajectoryFile);
+		fwrite (&colonyList[c].population, sizeof (int), 1, trajectoryFile);
+	}
+	fwrite (foodPos, sizeof (foodPos[0]), header.foodCount, trajectoryFile);
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			cell = obstaclePlace[i][j] == 1;
+			fwrite (&cell, 1, 1, trajectoryFile);
+		}
+	}
+	fflush (trajectoryFile);
+
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		trajectoryX[a_n] = antList[a_n].x;
+		trajectoryY[a_n] = antList[a_n].y;
+		trajectoryMode[a_n] = antList[a_n].mode;
+		trajectoryOut[a_n] = 0;
+		trajectorySpawned[a_n] = 0;
+	}
+
+	trajectoryFill = 0;
+	trajectoryCurrent = 0;
+	trajectoryPending = -1;
+	trajectoryStop = 0;
+	if (pthread_create (&trajectoryThread, NULL, trajectoryWriter, NULL) != 0) {
+		printf ("FAILED TO START TRAJECTORY WRITER\n");
+		fclose (trajectoryFile);
+		trajectoryFile = NULL;
+	}
+}
+
+/* Encodes step t from the difference with the last recorded state */
+void trajectoryRecord (int t) {
+	unsigned char *p = trajectoryBlock;
+	unsigned char *list;
+	int a_n, c, d, code, isOut, count, pair[2];
+
+	if (trajectoryFile == NULL) {
+		return;
+	}
+
+	memcpy (p, &t, sizeof (int));
+	p += sizeof (int);
+	memset (p, 0, ANT_NUM / 2 + 1);
+
+	/* spawns come first, so moves and mode changes apply after them */
+	/* the lists are not aligned in the block, so ints go in with memcpy */
+	list = p + ANT_NUM / 2 + 1;
+	count = 0;
+	for (c = 0; c < COLONY_NUM; c++) {
+		for (a_n = colonyList[c].first; a_n < colonyList[c].first + colonyList[c].population; a_n++) {
+			isOut = antIsOut (a_n);
+
+			if (isOut == 0) {
+				code = TRAJECTORY_INSIDE;
+			}
+			else {
+				if (trajectoryOut[a_n] == 0 || trajectorySpawned[a_n]) {
+					trajectoryX[a_n] = colonyList[c].nestX;
+					trajectoryY[a_n] = colonyList[c].nestY;
+					trajectoryMode[a_n] = 1;
+					trajectoryOut[a_n] = 1;
+					memcpy (list + sizeof (int) * (1 + count++), &a_n, sizeof (int));
+				}
+
+				code = TRAJECTORY_STAYED;
+				for (d = 0; d < 6; d++) {
+					if (antList[a_n].x == trajectoryX[a_n] + directionX[d] && antList[a_n].y == trajectoryY[a_n] + directionY[d]) {
+						code = d;
+					}
+				}
+				trajectoryX[a_n] = antList[a_n].x;
+				trajectoryY[a_n] = antList[a_n].y;
+			}
+			trajectorySpawned[a_n] = 0;
+
+			p[a_n / 2] |= code << (4 * (a_n % 2));
+		}
+	}
+	memcpy (list, &count, sizeof (int));
+
+	/* mode changes as ant and mode pairs */
+	list += sizeof (int) * (1 + count);
+	count = 0;
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		if (trajectoryOut[a_n] && antList[a_n].mode != trajectoryMode[a_n]) {
+			trajectoryMode[a_n] = antList[a_n].mode;
+			pair[0] = a_n;
+			pair[1] = antList[a_n].mode;
+			memcpy (list + sizeof (int) * (1 + 2 * count++), pair, sizeof (pair));
+		}
+	}
+	memcpy (list, &count, sizeof (int));
+	p = list + sizeof (int) * (1 + 2 * count);
+
+	trajectoryWrite (trajectoryBlock, p - trajectoryBlock);
+}
+
+/* Appends to the buffer being filled, handing full buffers to the writer */
+void trajectoryWrite (const void *data, int size) {
+	const unsigned char *p = (const unsigned char *) data;
+	int n;
+
+	while (size > 0) {
+		n = TRAJECTORY_BUFFER - trajectoryFill;
+		if (n > size) {
+			n = size;
+		}
+		memcpy (trajectoryBuffer[trajectoryCurrent] + trajectoryFill, p, n);
+		trajectoryFill += n;
+		p += n;
+		size -= n;
+
+		if (trajectoryFill == TRAJECTORY_BUFFER) {
+			trajectorySwap ();
+		}
+	}
+}
+
+/* Waits until the other buffer is written, then gives it this one */
+void trajectorySwap () {
+	pthread_mutex_lock (&trajectoryLock);
+	while (trajectoryPending >= 0) {
+		pthread_cond_wait (&trajectoryCond, &trajectoryLock);
+	}
+	trajectoryPending = trajectoryCurrent;
+	trajectoryPendingSize = trajectoryFill;
+	pthread_cond_broadcast (&trajectoryCond);
+	pthread_mutex_unlock (&trajectoryLock);
+
+	trajectoryCurrent = 1 - trajectoryCurrent;
+	trajectoryFill = 0;
+}
+
+/* Writer thread: writes whatever buffer is handed over until told to stop */
+void *trajectoryWriter (void *arg) {
+	int b, size;
+
+	pthread_mutex_lock (&trajectoryLock);
+	while (1) {
+		while (trajectoryPending < 0 && trajectoryStop == 0) {
+			pthread_cond_wait (&trajectoryCond, &trajectoryLock);
+		}
+		if (trajectoryPending < 0) {
+			break;
+		}
+		b = trajectoryPending;
+		size = trajectoryPendingSize;
+		pthread_mutex_unlock (&trajectoryLock);
+
+		fwrite (trajectoryBuffer[b], 1, size, trajectoryFile);
+		fflush (trajectoryFile);
+
+		pthread_mutex_lock (&trajectoryLock);
+		trajectoryPending = -1;
+		pthread_cond_broadcast (&trajectoryCond);
+	}
+	pthread_mutex_unlock (&trajectoryLock);
+
+	return arg;
+}
+
+/* Hands over what is left and waits for the writer */
+void trajectoryClose () {
+	if (trajectoryFile == NULL) {
+		return;
+	}
+
+	if (trajectoryFill > 0) {
+		trajectorySwap ();
+	}
+
+	pthread_mutex_lock (&trajectoryLock);
+	trajectoryStop = 1;
+	pthread_cond_broadcast (&trajectoryCond);
+	pthread_mutex_unlock (&trajectoryLock);
+	pthread_join (trajectoryThread, NULL);
+
+	fclose (trajectoryFile);
+	trajectoryFile = NULL;
+}
+
+# ifndef ANTSTRAIL_LIBRARY
+/* Rebuilds positions from a trajectory, draws them when there is a window, */
+/* and writes how many times each cell was visited; a torn last block ends it */
+int trajectoryReplay (const char *fileName, const char *csvName) {
+	static long long visits[L_MAX * 2 + 1][L_MAX * 2 + 1];
+	unsigned char codes[ANT_NUM / 2 + 1], cell;
+	trajectoryHeader header;
+	FILE *in, *out;
+	int a_n, c, d, i, j, t, n, k, pair[2], nest[4];
+	int steps = 0, first = 0, isOk = 1, isCut = 0;
+
+	if ((in = fopen (fileName, "rb")) == NULL) {
+		printf ("FAILED TO OPEN %s\n", fileName);
+		return 0;
+	}
+	if (fread (&header, sizeof (header), 1, in) != 1 || memcmp (header.magic, "ATRJ", 4) != 0 || header.version != TRAJECTORY_VERSION) {
+		printf ("INVALID TRAJECTORY %s\n", fileName);
+		fclose (in);
+		return 0;
+	}
+	if (header.lMax != L_MAX || header.antNum != ANT_NUM || header.colonyNum != COLONY_NUM || header.foodCount > FOOD_NUM * 7) {
+		printf ("TRAJECTORY %s DOES NOT MATCH THIS BUILD\n", fileName);
+		fclose (in);
+		return 0;
+	}
+
+	seed = header.seed;
+	honeyCombInitialization ();
+
+	/* colonies have to cover antList in order, with nests on the grid */
+	for (c = 0; isOk && c < COLONY_NUM; c++) {
+		isOk = fread (nest, sizeof (nest), 1, in) == 1 && nest[0] >= 0 && nest[0] <= L_MAX * 2 && nest[1] >= 0 && nest[1] <= L_MAX * 2 && nest[2] == first && nest[3] >= 0 && nest[3] <= ANT_NUM - first;
+		if (isOk == 0) {
+			break;
+		}
+		colonyList[c].nestX = nest[0];
+		colonyList[c].nestY = nest[1];
+		colonyList[c].first = nest[2];
+		colonyList[c].population = nest[3];
+		first += nest[3];
+
+		for (a_n = colonyList[c].first; a_n < colonyList[c].first + colonyList[c].population; a_n++) {
+			antList[a_n].colony = c;
+			antList[a_n].x = colonyList[c].nestX;
+			antList[a_n].y = colonyList[c].nestY;
+			antList[a_n].mode = 1;
+		}
+	}
+	isOk = isOk && first == ANT_NUM && header.foodCount >= 0 && (int) fread (foodPos, sizeof (foodPos[0]), header.foodCount, in) == header.foodCount;
+	for (i = 0; isOk && i < L_MAX * 2 + 1; i++) {
+		for (j = 0; isOk && j < L_MAX * 2 + 1; j++) {
+			isOk = fread (&cell, 1, 1, in) == 1;
+			obstaclePlace[i][j] = cell != 0;
+			visits[i][j] = 0;
+		}
+	}
+	if (isOk == 0) {
+		printf ("INVALID TRAJECTORY %s\n", fileName);
+		fclose (in);
+		return 0;
+	}
+
+	if (doesDraw) {
+		graphicInitialization();
+		backgroundInitialization();
+		drawAllObstacles ();
+	}
+
+	/* a block cut short ends the replay, a value out of range fails it */
+	while (isOk && isCut == 0 && fread (&t, sizeof (int), 1, in) == 1) {
+		if (fread (codes, sizeof (codes), 1, in) != 1 || fread (&n, sizeof (int), 1, in) != 1) {
+			isCut = 1;
+			break;
+		}
+
+		if (doesDraw) {
+			g_sel_scale (1);
+			for (a_n = 0; a_n < ANT_NUM; a_n++) {
+				plotAnt (a_n, 0);
+			}
+		}
+
+		if (n < 0 || n > ANT_NUM) {
+			isOk = 0;
+			break;
+		}
+		for (k = 0; k < n; k++) {
+			if (fread (&a_n, sizeof (int), 1, in) != 1) {
+				isCut = 1;
+				break;
+			}
+			if (a_n < 0 || a_n >= ANT_NUM) {
+				isOk = 0;
+				break;
+			}
+			antList[a_n].x = colonyList[antList[a_n].colony].nestX;
+			antList[a_n].y = colonyList[antList[a_n].colony].nestY;
+			antList[a_n].mode = 1;
+		}
+		if (isOk == 0 || isCut) {
+			break;
+		}
+
+		for (a_n = 0; a_n < ANT_NUM; a_n++) {
+			d = (codes[a_n / 2] >> (4 * (a_n % 2))) & 15;
+			if (d < 6) {
+				antList[a_n].x += directionX[d];
+				antList[a_n].y += directionY[d];
+			}
+			if (antList[a_n].x < 0 || antList[a_n].x > L_MAX * 2 || antList[a_n].y < 0 || antList[a_n].y > L_MAX * 2) {
+				isOk = 0;
+				break;
+			}
+			if (d != TRAJECTORY_INSIDE) {
+				visits[antList[a_n].x][antList[a_n].y]++;
+			}
+		}
+		if (isOk == 0) {
+			break;
+		}
+
+		if (fread (&n, sizeof (int), 1, in) != 1) {
+			isCut = 1;
+			break;
+		}
+		if (n < 0 || n > ANT_NUM) {
+			isOk = 0;
+			break;
+		}
+		for (k = 0; k < n; k++) {
+			if (fread (pair, sizeof (pair), 1, in) != 1) {
+				isCut = 1;
+				break;
+			}
+			if (pair[0] < 0 || pair[0] >= ANT_NUM) {
+				isOk = 0;
+				break;
+			}
+			antList[pair[0]].mode = pair[1];
+		}
+		if (isOk == 0 || isCut) {
+			break;
+		}
+		steps++;
+
+		if (doesDraw) {
+			for (a_n = 0; a_n < ANT_NUM; a_n++) {
+				if (((codes[a_n / 2] >> (4 * (a_n % 2))) & 15) != TRAJECTORY_INSIDE) {
+					plotAnt (a_n, antList[a_n].mode == 1 ? 7 : antList[a_n].mode == 2 ? 1 : 2);
+				}
+			}
+			drawAllFood ();
+			g_sleep (FPS);
+		}
+	}
+	fclose (in);
+
+	if (isOk == 0) {
+		printf ("CORRUPT TRAJECTORY %s AFTER %d STEPS\n", fileName, steps);
+		if (doesDraw) {
+			g_term ();
+		}
+		return 0;
+	}
+	if (isCut) {
+		printf ("TRAJECTORY %s IS CUT SHORT\n", fileName);
+	}
+	printf ("%d steps replayed\n", steps);
+
+	if ((out = fopen (csvName, "w")) == NULL) {
+		printf ("FAILED TO CREATE FILE");
+		return 0;
+	}
+	fprintf (out, "x,y,visits\n");
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			if (visits[i][j] > 0) {
+				fprintf (out, "%d,%d,%lld\n", i, j, visits[i][j]);
+			}
+		}
+	}
+	fclose (out);
+
+	if (doesDraw) {
+		g_sleep (G_STOP);
+		g_term ();
+	}
+	return 1;
+}
+# endif
+
+/* ----------------------------- HEATMAP -------------------------------- */
+
+/* Makes <run>.heat and starts the workers */
+void heatmapInitialization () {
+	char *env = getenv ("ANTS_HEATMAP");
+	int k;
+
+	if (env != NULL) {
+		heatmapInterval = atoi (env);
+	}
+	isExporting = 0;
+	if (heatmapInterval <= 0 || doesWrite == 0) {
+		return;
+	}
+
+	sprintf (heatmapDir, "%s.heat", runName);
+	if (mkdir (heatmapDir, 0755) != 0 && access (heatmapDir, W_OK) != 0) {
+		printf ("FAILED TO CREATE %s\n", heatmapDir);
+		return;
+	}
+
+	for (k = 0; k < HEATMAP_QUEUE; k++) {
+		heatmapSlots[k].state = HEATMAP_FREE;
+	}
+	heatmapStop = 0;
+	heatmapWritten = 0;
+	heatmapDropped = 0;
+
+	for (k = 0; k < HEATMAP_WORKERS; k++) {
+		if (pthread_create (&heatmapThread[k], NULL, heatmapWorker, NULL) != 0) {
+			printf ("FAILED TO START HEATMAP WORKER\n");
+			break;
+		}
+	}
+	isExporting = k;
+}
+
+/* Copies the pheromone planes into a free slot, or drops step t if there is none */
+void heatmapCapture (int t) {
+	heatmapSlot *slot = NULL;
+	int i, j, k;
+
+	pthread_mutex_lock (&heatmapLock);
+	for (k = 0; k < HEATMAP_QUEUE && slot == NULL; k++) {
+		if (heatmapSlots[k].state == HEATMAP_FREE) {
+			slot = &heatmapSlots[k];
+			slot->state = HEATMAP_FILLING;
+		}
+	}
+	if (slot == NULL) {
+		heatmapDropped++;
+	}
+	pthread_mutex_unlock (&heatmapLock);
+
+	if (slot == NULL) {
+		return;
+	}
+
+	slot->step = t;
+	for (k = 0; k < 2 * SPECIES_NUM; k++) {
+		slot->max[k] = fieldStats[k].max;
+	}
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			for (k = 0; k < 2 * SPECIES_NUM; k++) {
+				slot->field[k][i][j] = pheromone[i][j][k];
+			}
+		}
+	}
+
+	pthread_mutex_lock (&heatmapLock);
+	slot->state = HEATMAP_QUEUED;
+	pthread_cond_signal (&heatmapCond);
+	pthread_mutex_unlock (&heatmapLock);
+}
+
+/* Worker: writes the oldest queued snapshot, and leaves once told to and empty */
+void *heatmapWorker (void *arg) {
+	unsigned char *image = (unsigned char *) malloc (HEATMAP_HEIGHT * HEATMAP_WIDTH * 3);
+	heatmapSlot *slot;
+	int k, isWritten;
+
+	pthread_mutex_lock (&heatmapLock);
+	while (1) {
+		slot = NULL;
+		for (k = 0; k < HEATMAP_QUEUE; k++) {
+			if (heatmapSlots[k].state == HEATMAP_QUEUED && (slot == NULL || heatmapSlots[k].step < slot->step)) {
+				slot = &heatmapSlots[k];
+			}
+		}
+
+		if (slot == NULL) {
+			if (heatmapStop) {
+				break;
+			}
+			pthread_cond_wait (&heatmapCond, &heatmapLock);
+			continue;
+		}
+
+		slot->state = HEATMAP_ENCODING;
+		pthread_mutex_unlock (&heatmapLock);
+
+		isWritten = image != NULL && heatmapWrite (slot, image);
+
+		pthread_mutex_lock (&heatmapLock);
+		heatmapWritten += isWritten;
+		slot->state = HEATMAP_FREE;
+	}
+	pthread_mutex_unlock (&heatmapLock);
+	free (image);
+
+	return arg;
+}
+
+/* Writes one snapshot as a binary PPM, each plane normalized by its own max */
+int heatmapWrite (heatmapSlot *slot, unsigned char *image) {
+	char fileName[80];
+	double max;
+	FILE *fp;
+	int i, j, k, left, row, col;
+	unsigned char rgb[3], *p;
+
+	memset (image, 0, HEATMAP_HEIGHT * HEATMAP_WIDTH * 3);
+
+	for (k = 0; k < 2 * SPECIES_NUM; k++) {
+		max = slot->max[k];
+		left = k * (HEATMAP_PANEL_WIDTH + 2);
+		for (i = 0; i < L_MAX * 2 + 1; i++) {
+			for (j = 0; j < L_MAX * 2 + 1; j++) {
+				row = 2 * i + j - L_MAX;
+				if (row < 0 || row > 4 * L_MAX) {
+					continue;
+				}
+
+				if (slot->field[k][i][j] >= 0) {
+					heatmapColor (max > 0 ? slot->field[k][i][j] / max : 0, rgb);
+				}
+				else if (obstaclePlace[i][j] == 1) {
+					rgb[0] = rgb[1] = rgb[2] = 96;
+				}
+				else {
+					continue;
+				}
+
+				col = left + 2 * j;
+				p = image + (row * HEATMAP_WIDTH + col) * 3;
+				memcpy (p, rgb, 3);
+				memcpy (p + 3, rgb, 3);
+				memcpy (p + HEATMAP_WIDTH * 3, rgb, 3);
+				memcpy (p + HEATMAP_WIDTH * 3 + 3, rgb, 3);
+			}
+		}
+	}
+
+	sprintf (fileName, "%s/%07d.ppm", heatmapDir, slot->step);
+	if ((fp = fopen (fileName, "wb")) == NULL) {
+		printf ("FAILED TO CREATE %s\n", fileName);
+		return 0;
+	}
+	fprintf (fp, "P6\n%d %d\n255\n", HEATMAP_WIDTH, HEATMAP_HEIGHT);
+	fwrite (image, HEATMAP_HEIGHT * HEATMAP_WIDTH * 3, 1, fp);
+	fclose (fp);
+
+	return 1;
+}
+
+/* Black through red and yellow to white for v in 0 ~ 1 */
+void heatmapColor (double v, unsigned char *rgb) {
+	v = fmin (fmax (v, 0), 1) * 3;
+
+	rgb[0] = (unsigned char) (255 * fmin (v, 1));
+	rgb[1] = (unsigned char) (255 * fmin (fmax (v - 1, 0), 1));
+	rgb[2] = (unsigned char) (255 * fmin (fmax (v - 2, 0), 1));
+}
+
+/* Waits for the queued snapshots to be written and stops the workers */
+void heatmapClose () {
+	int k;
+
+	if (isExporting == 0) {
+		return;
+	}
+
+	pthread_mutex_lock (&heatmapLock);
+	heatmapStop = 1;
+	pthread_cond_broadcast (&heatmapCond);
+	pthread_mutex_unlock (&heatmapLock);
+
+	for (k = 0; k < isExporting; k++) {
+		pthread_join (heatmapThread[k], NULL);
+	}
+	isExporting = 0;
+
+	if (isQuiet == 0) {
+		printf ("%d heatmaps written to %s, %d dropped\n", heatmapWritten, heatmapDir, heatmapDropped);
+	}
+}
+
+/* ---------------------------- TELEMETRY -------------------------------- */
+
+/* Creates /antstrail.<run> for monitors to attach to; quiet runs publish too, */
+/* and a worker's earlier run is finished first */
+void telemetryInitialization () {
+	char *env = getenv ("ANTS_TELEMETRY");
+	int fd;
+
+	telemetryClose ();
+	if (env != NULL) {
+		doesTelemetry = atoi (env);
+	}
+	if (doesTelemetry == 0) {
+		return;
+	}
+
+	sprintf (telemetryName, "/antstrail.%s", runName);
+	if ((fd = shm_open (telemetryName, O_CREAT | O_RDWR | O_TRUNC, 0644)) < 0) {
+		printf ("FAILED TO CREATE TELEMETRY %s\n", telemetryName);
+		return;
+	}
+	if (ftruncate (fd, sizeof (telemetrySegment)) != 0 || (telemetry = (telemetrySegment *) mmap (NULL, sizeof (telemetrySegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		printf ("FAILED TO MAP TELEMETRY %s\n", telemetryName);
+		telemetry = NULL;
+		close (fd);
+		shm_unlink (telemetryName);
+		return;
+	}
+	close (fd);
+
+	telemetry->version = TELEMETRY_VERSION;
+	telemetry->pid = getpid ();
+	telemetry->colonyNum = COLONY_NUM;
+	telemetry->ring = TELEMETRY_RING;
+	telemetry->thumbnailSide = TELEMETRY_THUMBNAIL;
+	telemetry->thumbnailStep = -1;
+	memcpy (telemetry->magic, "ATLM", 4);
+
+	telemetryLastClock = profileClock ();
+	telemetryLastStep = 0;
+	telemetrySpeed = 0;
+}
+
+/* Appends the record of step t, and new thumbnails every N steps */
+void telemetryPublish (int t) {
+	long long head = telemetry->head;
+	long long now = profileClock ();
+	telemetryRecord *r = &telemetry->records[head % TELEMETRY_RING];
+	int c, k;
+
+	/* steps per second over the last TELEMETRY_INTERVAL steps, smoothed */
+	if (now > telemetryLastClock && t > telemetryLastStep) {
+		telemetrySpeed = telemetrySpeed == 0 ? (t - telemetryLastStep) * 1e9 / (now - telemetryLastClock) : 0.9 * telemetrySpeed + 0.1 * (t - telemetryLastStep) * 1e9 / (now - telemetryLastClock);
+	}
+	telemetryLastClock = now;
+	telemetryLastStep = t;
+
+	modeRatio ();
+
+	__atomic_store_n (&r->seq, -1LL, __ATOMIC_RELAXED);
+	__atomic_thread_fence (__ATOMIC_RELEASE);
+
+	r->step = t;
+	memcpy (r->ratio, ratio, sizeof (ratio));
+	for (c = 0; c < COLONY_NUM; c++) {
+		r->comeBack[c] = colonyList[c].comeBack;
+		r->totalAnt[c] = colonyList[c].totalAnt;
+	}
+	r->stepsPerSec = telemetrySpeed;
+	memcpy (r->phaseNs, phaseTime, sizeof (phaseTime));
+
+	__atomic_store_n (&r->seq, head, __ATOMIC_RELEASE);
+	__atomic_store_n (&telemetry->head, head + 1, __ATOMIC_RELEASE);
+
+	if (t % N == 0) {
+		__atomic_store_n (&telemetry->thumbnailSeq, telemetry->thumbnailSeq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence (__ATOMIC_RELEASE);
+		for (k = 0; k < 2; k++) {
+			pyramidThumbnail (k, TELEMETRY_THUMBNAIL, telemetry->thumbnail[k]);
+		}
+		telemetry->thumbnailStep = t;
+		__atomic_store_n (&telemetry->thumbnailSeq, telemetry->thumbnailSeq + 1, __ATOMIC_RELEASE);
+	}
+}
+
+/* Marks the run finished; attached monitors keep their mapping */
+void telemetryClose () {
+	if (telemetry == NULL) {
+		return;
+	}
+
+	__atomic_store_n (&telemetry->isFinished, 1, __ATOMIC_RELEASE);
+	munmap (telemetry, sizeof (telemetrySegment));
+	telemetry = NULL;
+	shm_unlink (telemetryName);
+}
+
+/* Follows /antstrail.<run>: a live view, or every record as csv lines */
+int telemetryMonitor (const char *run, int isCsv) {
+	const char *shade = " .:-=+*#%@";
+	telemetrySegment *seg;
+	telemetryRecord r, last;
+	float thumbnail[2][TELEMETRY_THUMBNAIL * TELEMETRY_THUMBNAIL];
+	char name[64];
+	long long head, next = 0, seq;
+	double max[2];
+	int fd, c, i, k, u, v, thumbnailStep = -1, hasLast = 0;
+
+	memset (&last, 0, sizeof (last));
+	sprintf (name, "/antstrail.%s", run);
+	if ((fd = shm_open (name, O_RDONLY, 0)) < 0) {
+		printf ("NO TELEMETRY FOR %s\n", run);
+		return 0;
+	}
+	seg = (telemetrySegment *) mmap (NULL, sizeof (telemetrySegment), PROT_READ, MAP_SHARED, fd, 0);
+	close (fd);
+	if (seg == MAP_FAILED || memcmp (seg->magic, "ATLM", 4) != 0 || seg->version != TELEMETRY_VERSION || seg->colonyNum != COLONY_NUM || seg->ring != TELEMETRY_RING || seg->thumbnailSide != TELEMETRY_THUMBNAIL) {
+		printf ("TELEMETRY %s DOES NOT MATCH THIS BUILD\n", run);
+		return 0;
+	}
+
+	if (isCsv) {
+		printf ("STEP,MODE_ONE,MODE_TWO,MODE_THREE,STEPS_PER_SEC");
+		for (c = 0; c < COLONY_NUM; c++) {
+			printf (",COME_BACK_%d,TOTAL_ANT_%d", c, c);
+		}
+		printf ("\n");
+	}
+
+	while (1) {
+		head = __atomic_load_n (&seg->head, __ATOMIC_ACQUIRE);
+
+		/* the writer has lapped us; skip to the oldest record still there */
+		if (head - next > TELEMETRY_RING) {
+			if (isCsv) {
+				fprintf (stderr, "%lld records skipped\n", head - TELEMETRY_RING - next);
+			}
+			next = head - TELEMETRY_RING;
+		}
+		if (isCsv == 0 && head > next) {
+			next = head - 1;
+		}
+
+		for (; next < head; next++) {
+			seq = __atomic_load_n (&seg->records[next % TELEMETRY_RING].seq, __ATOMIC_ACQUIRE);
+			memcpy (&r, &seg->records[next % TELEMETRY_RING], sizeof (r));
+			__atomic_thread_fence (__ATOMIC_ACQUIRE);
+			if (seq != next || __atomic_load_n (&seg->records[next % TELEMETRY_RING].seq, __ATOMIC_RELAXED) != next) {
+				continue;
+			}
+
+			if (isCsv) {
+				printf ("%d,%d,%d,%d,%.1lf", r.step, r.ratio[0], r.ratio[1], r.ratio[2], r.stepsPerSec);
+				for (c = 0; c < COLONY_NUM; c++) {
+					printf (",%d,%d", r.comeBack[c], r.totalAnt[c]);
+				}
+				printf ("\n");
+			}
+			else {
+				last = r;
+				hasLast = 1;
+			}
+		}
+
+		if (isCsv == 0 && hasLast) {
+			seq = __atomic_load_n (&seg->thumbnailSeq, __ATOMIC_ACQUIRE);
+			if (seq % 2 == 0 && seg->thumbnailStep >= 0) {
+				memcpy (thumbnail, seg->thumbnail, sizeof (thumbnail));
+				i = seg->thumbnailStep;
+				__atomic_thread_fence (__ATOMIC_ACQUIRE);
+				if (__atomic_load_n (&seg->thumbnailSeq, __ATOMIC_RELAXED) == seq) {
+					thumbnailStep = i;
+				}
+			}
+
+			printf ("\033[H\033[2J");
+			printf ("STEP %d   %.1lf steps/s\n", last.step, last.stepsPerSec);
+			printf ("MODE %d / %d / %d\n", last.ratio[0], last.ratio[1], last.ratio[2]);
+			for (c = 0; c < COLONY_NUM; c++) {
+				printf ("COLONY %d  %d / %d\n", c, last.comeBack[c], last.totalAnt[c]);
+			}
+			for (i = 0; i < PHASE_NUM; i++) {
+				if (last.phaseNs[i] > 0) {
+					printf ("  %-14s %14lld ns\n", phaseName[i], last.phaseNs[i]);
+				}
+			}
+
+			if (thumbnailStep >= 0) {
+				printf ("PHEROMONE ONE / TWO at step %d\n", thumbnailStep);
+				for (k = 0; k < 2; k++) {
+					max[k] = 0;
+					for (i = 0; i < TELEMETRY_THUMBNAIL * TELEMETRY_THUMBNAIL; i++) {
+						max[k] = fmax (max[k], thumbnail[k][i]);
+					}
+				}
+				for (u = 0; u < TELEMETRY_THUMBNAIL; u++) {
+					for (k = 0; k < 2; k++) {
+						for (v = 0; v < TELEMETRY_THUMBNAIL; v++) {
+							i = max[k] > 0 ? (int) (9.99 * thumbnail[k][u * TELEMETRY_THUMBNAIL + v] / max[k]) : 0;
+							printf ("%c%c", shade[i], shade[i]);
+						}
+						printf ("  ");
+					}
+					printf ("\n");
+				}
+			}
+			fflush (stdout);
+		}
+
+		if (__atomic_load_n (&seg->isFinished, __ATOMIC_ACQUIRE) && next >= __atomic_load_n (&seg->head, __ATOMIC_ACQUIRE)) {
+			break;
+		}
+		if (kill (seg->pid, 0) != 0) {
+			printf ("RUN %s HAS GONE\n", run);
+			break;
+		}
+		usleep (isCsv ? 10000 : 200000);
+	}
+
+	munmap (seg, sizeof (telemetrySegment));
+	return 1;
+}
+
+/* ---------------------------- RANDOM --------------------------------- */
+
+/* Splitmix64 spreads the seed so that nearby seeds start far apart */
+void randomSeed (unsigned long long s) {
+	s += 0x9E3779B97F4A7C15ULL;
+	s = (s ^ (s >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	s = (s ^ (s >> 27)) * 0x94D049BB133111EBULL;
+	s ^= s >> 31;
+
+	randomState = s == 0 ? 1 : s;
+}
+
+/* 0 ~ RANDOM_MAX, used like rand () */
+int randomNext () {
+	randomState ^= randomState >> 12;
+	randomState ^= randomState << 25;
+	randomState ^= randomState >> 27;
+
+	if (isAntithetic) {
+		return RANDOM_MAX - (int) ((randomState * 0x2545F4914F6CDD1DULL) >> 33);
+	}
+	return (int) ((randomState * 0x2545F4914F6CDD1DULL) >> 33);
+}
+
+/* 0 ~ k - 1 scaled from the draw, so an antithetic draw picks from the other end; */
+/* randomNext () % k would leave the two runs of a pair with unrelated choices */
+int randomBelow (int k) {
+	return (int) (randomNext () / (RANDOM_MAX + 1.0) * k);
+}
+
+/* ----------------------------- SCENARIO -------------------------------- */
+
+/* ANTS_SCENARIOS, or SCENARIO_FILE in the working directory */
+const char *scenarioLibraryName () {
+	char *env = getenv ("ANTS_SCENARIOS");
+
+	return env != NULL ? env : SCENARIO_FILE;
+}
+
+/* Maps a library once, later calls keep the first one; 0 if there is none or it is invalid */
+int scenarioOpen (const char *fileName) {
+	const scenarioHeader *header;
+	const long long *offset;
+	struct stat st;
+	void *map;
+	int fd, i;
+
+	if (scenarioMap != NULL) {
+		return 1;
+	}
+	if ((fd = open (fileName, O_RDONLY)) < 0) {
+		return 0;
+	}
+	if (fstat (fd, &st) != 0 || st.st_size < (off_t) sizeof (scenarioHeader) || (map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close (fd);
+		return 0;
+	}
+	close (fd);
+
+	header = (const scenarioHeader *) map;
+	offset = (const long long *) (header + 1);
+	if (memcmp (header->magic, "ASCN", 4) != 0 || header->version != SCENARIO_VERSION || header->count < 0 || sizeof (scenarioHeader) + sizeof (long long) * header->count > (size_t) st.st_size) {
+		printf ("INVALID SCENARIO LIBRARY %s\n", fileName);
+		munmap (map, st.st_size);
+		return 0;
+	}
+	if (header->lMax != L_MAX || header->colonyNum != COLONY_NUM || header->foodNum != FOOD_NUM || header->surroundingMode != SURROUNDING_MODE) {
+		printf ("SCENARIO LIBRARY %s DOES NOT MATCH THIS BUILD\n", fileName);
+		munmap (map, st.st_size);
+		return 0;
+	}
+	for (i = 0; i < header->count; i++) {
+		const scenarioRecord *r = (const scenarioRecord *) ((const char *) map + offset[i]);
+
+		if (offset[i] < 0 || offset[i] % 8 != 0 || offset[i] + (long long) sizeof (scenarioRecord) > st.st_size || r->obstacleCount < 0 || r->cellCount < 0
+			|| offset[i] + (long long) sizeof (scenarioRecord) + 2LL * (long long) sizeof (short) * r->obstacleCount + (long long) sizeof (scenarioCell) * r->cellCount > st.st_size
+			|| scenarioValid (r) == 0) {
+			printf ("INVALID SCENARIO LIBRARY %s\n", fileName);
+			munmap (map, st.st_size);
+			return 0;
+		}
+	}
+
+	scenarioMap = map;
+	scenarioSize = st.st_size;
+	scenarioCount = header->count;
+	return 1;
+}
+
+/* Every nest, food cell, obstacle and pheromone cell of a mapped record lies on */
+/* the board, and every plane and value can be used as is */
+int scenarioValid (const scenarioRecord *r) {
+	const short *obstacle = (const short *) (r + 1);
+	const scenarioCell *cell = (const scenarioCell *) (obstacle + 2 * r->obstacleCount);
+	int c, f, o;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		if (r->nest[c][0] < 0 || r->nest[c][0] > L_MAX * 2 || r->nest[c][1] < 0 || r->nest[c][1] > L_MAX * 2) {
+			return 0;
+		}
+	}
+	for (f = 0; f < (SURROUNDING_MODE == 0 ? FOOD_NUM : FOOD_NUM * 7); f++) {
+		if (r->food[f][0] < 0 || r->food[f][0] > L_MAX * 2 || r->food[f][1] < 0 || r->food[f][1] > L_MAX * 2) {
+			return 0;
+		}
+	}
+	for (o = 0; o < r->obstacleCount; o++) {
+		if (obstacle[2 * o] < 0 || obstacle[2 * o] > L_MAX * 2 || obstacle[2 * o + 1] < 0 || obstacle[2 * o + 1] > L_MAX * 2) {
+			return 0;
+		}
+	}
+	for (o = 0; o < r->cellCount; o++) {
+		if (cell[o].x < 0 || cell[o].x > L_MAX * 2 || cell[o].y < 0 || cell[o].y > L_MAX * 2 || cell[o].plane < 0 || cell[o].plane >= 2 * SPECIES_NUM || !isfinite (cell[o].value) || cell[o].value < 0) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Scenario id of the mapped library, NULL if there is no such one */
+const scenarioRecord *scenarioFind (int id) {
+	const long long *offset = (const long long *) (scenarioMap + sizeof (scenarioHeader));
+
+	if (scenarioMap == NULL || id < 0 || id >= scenarioCount) {
+		return NULL;
+	}
+	return (const scenarioRecord *) (scenarioMap + offset[id]);
+}
+
+/* Picks the scenario of param for this run */
+void scenarioInitialization () {
+	activeScenario = NULL;
+
+	if (param.scenario < 0) {
+		return;
+	}
+	if ((activeScenario = scenarioFind ((int) param.scenario)) == NULL) {
+		printf ("NO SCENARIO %d IN %s\n", (int) param.scenario, scenarioLibraryName ());
+		exit (1);
+	}
+	if (isQuiet == 0) {
+		printf ("SCENARIO %d: %s\n", (int) param.scenario, activeScenario->name);
+	}
+}
+
+/* Compiles text sources into a library, one record per "scenario <name>" line: */
+/* nest <colony> <x> <y>, food <x> <y> (FOOD_NUM patches), obstacle <x> <y>, */
+/* pheromone <x> <y> <plane> <value>, and trail <x0> <y0> <x1> <y1> <plane> <from> [<to>] */
+/* for a straight hex line of pheromone going from one value to the other; */
+/* nests left out stay where COLONY_DEFAULT puts them */
+int scenarioBuild (const char *libraryName, int count, char *sourceName[]) {
+	scenarioHeader header;
+	scenarioRecord *record = NULL;
+	short *obstacle = NULL;
+	scenarioCell *cell = NULL;
+	long long *offset = NULL;
+	long long position;
+	void *grown;
+	char line[256], word[32], tempName[272];
+	FILE *in, *out;
+	int i, c, n = 0, foodCount = 0, lineNumber, x, y, plane, isOk = 1;
+	int x1, y1, length, step, words;
+	double value, endValue, cube[3], rounded[3], error[3];
+
+	/* the records are kept in memory until every offset is known */
+	int capacity = 0, obstacleCapacity = 0, cellCapacity = 0;
+	int *obstacleTotal = NULL, *cellTotal = NULL;
+	short **obstacleList = NULL;
+	scenarioCell **cellList = NULL;
+
+	honeyCombInitialization ();
+
+	for (i = 0; isOk && i < count; i++) {
+		if ((in = fopen (sourceName[i], "r")) == NULL) {
+			printf ("FAILED TO OPEN %s\n", sourceName[i]);
+			isOk = 0;
+			break;
+		}
+		for (lineNumber = 1; isOk && fgets (line, sizeof (line), in) != NULL; lineNumber++) {
+			line[strcspn (line, "\r\n#")] = '\0';
+			if (sscanf (line, "%31s", word) != 1) {
+				continue;
+			}
+
+			if (strcmp (word, "scenario") == 0) {
+				if (n > 0 && foodCount != FOOD_NUM) {
+					printf ("%s: SCENARIO %s HAS %d FOOD PATCHES, NOT %d\n", sourceName[i], record[n - 1].name, foodCount, FOOD_NUM);
+					isOk = 0;
+					break;
+				}
+				if (n > 0 && scenarioCheck (&record[n - 1], obstacleList[n - 1], obstacleTotal[n - 1]) == 0) {
+					isOk = 0;
+					break;
+				}
+				if (n == capacity) {
+					/* every list keeps its old block until all of them have grown */
+					if ((grown = realloc (record, sizeof (scenarioRecord) * (capacity * 2 + 8))) != NULL) {
+						record = grown;
+					}
+					if (grown != NULL && (grown = realloc (obstacleList, sizeof (short *) * (capacity * 2 + 8))) != NULL) {
+						obstacleList = grown;
+					}
+					if (grown != NULL && (grown = realloc (cellList, sizeof (scenarioCell *) * (capacity * 2 + 8))) != NULL) {
+						cellList = grown;
+					}
+					if (grown != NULL && (grown = realloc (obstacleTotal, sizeof (int) * (capacity * 2 + 8))) != NULL) {
+						obstacleTotal = grown;
+					}
+					if (grown != NULL && (grown = realloc (cellTotal, sizeof (int) * (capacity * 2 + 8))) != NULL) {
+						cellTotal = grown;
+					}
+					if (grown == NULL) {
+						printf ("OUT OF MEMORY AT SCENARIO %d\n", n);
+						isOk = 0;
+						break;
+					}
+					capacity = capacity * 2 + 8;
+				}
+				memset (&record[n], 0, sizeof (scenarioRecord));
+				sscanf (line, "%*s %31s", record[n].name);
+				for (c = 0; c < COLONY_NUM; c++) {
+					record[n].nest[c][0] = colonyDefault[c].nestX;
+					record[n].nest[c][1] = colonyDefault[c].nestY;
+				}
+				obstacleList[n] = obstacle = NULL;
+				cellList[n] = cell = NULL;
+				obstacleTotal[n] = cellTotal[n] = 0;
+				obstacleCapacity = cellCapacity = 0;
+				foodCount = 0;
+				n++;
+				continue;
+			}
+
+			if (n == 0) {
+				printf ("%s:%d: NO scenario LINE BEFORE %s\n", sourceName[i], lineNumber, word);
+				isOk = 0;
+			}
+			else if (strcmp (word, "nest") == 0 && sscanf (line, "%*s %d %d %d", &c, &x, &y) == 3 && c >= 0 && c < COLONY_NUM && isOpenCell (x, y)) {
+				record[n - 1].nest[c][0] = x;
+				record[n - 1].nest[c][1] = y;
+			}
+			else if (strcmp (word, "food") == 0 && sscanf (line, "%*s %d %d", &x, &y) == 2 && foodCount < FOOD_NUM && isOpenCell (x, y)) {
+				placeFood (foodCount++, x, y);
+				memcpy (record[n - 1].food, foodPos, sizeof (foodPos));
+			}
+			else if (strcmp (word, "obstacle") == 0 && sscanf (line, "%*s %d %d", &x, &y) == 2 && isOpenCell (x, y)) {
+				if (obstacleTotal[n - 1] == obstacleCapacity) {
+					if ((grown = realloc (obstacle, sizeof (short) * 2 * (obstacleCapacity * 2 + 64))) == NULL) {
+						printf ("%s:%d: OUT OF MEMORY\n", sourceName[i], lineNumber);
+						isOk = 0;
+						continue;
+					}
+					obstacleList[n - 1] = obstacle = grown;
+					obstacleCapacity = obstacleCapacity * 2 + 64;
+				}
+				obstacle[2 * obstacleTotal[n - 1]] = x;
+				obstacle[2 * obstacleTotal[n - 1] + 1] = y;
+				obstacleTotal[n - 1]++;
+			}
+			else if (strcmp (word, "pheromone") == 0 || strcmp (word, "trail") == 0) {
+				/* a single cell is a trail of length 0 */
+				if (strcmp (word, "pheromone") == 0) {
+					words = sscanf (line, "%*s %d %d %d %lf", &x, &y, &plane, &value) == 4 ? 6 : 0;
+					x1 = x;
+					y1 = y;
+				}
+				else {
+					words = sscanf (line, "%*s %d %d %d %d %d %lf %lf", &x, &y, &x1, &y1, &plane, &value, &endValue);
+				}
+				if (words == 6) {
+					endValue = value;
+				}
+				if (words < 6 || isOpenCell (x, y) == 0 || isOpenCell (x1, y1) == 0 || plane < 0 || plane >= 2 * SPECIES_NUM || value < 0 || endValue < 0) {
+					printf ("%s:%d: INVALID LINE %s\n", sourceName[i], lineNumber, line);
+					isOk = 0;
+					continue;
+				}
+
+				/* hex distance, then each point of the line rounded in cube coordinates */
+				length = (abs (x1 - x) + abs (y1 - y) + abs (x1 - x + y1 - y)) / 2;
+				for (step = 0; step <= length; step++) {
+					cube[0] = x + (x1 - x) * (length > 0 ? step / (double) length : 0);
+					cube[1] = y + (y1 - y) * (length > 0 ? step / (double) length : 0);
+					cube[2] = -cube[0] - cube[1];
+					for (c = 0; c < 3; c++) {
+						rounded[c] = floor (cube[c] + 0.5);
+						error[c] = fabs (rounded[c] - cube[c]);
+					}
+					if (error[0] > error[1] && error[0] > error[2]) {
+						rounded[0] = -rounded[1] - rounded[2];
+					}
+					else if (error[1] > error[2]) {
+						rounded[1] = -rounded[0] - rounded[2];
+					}
+					if (isOpenCell ((int) rounded[0], (int) rounded[1]) == 0) {
+						continue;
+					}
+
+					if (cellTotal[n - 1] == cellCapacity) {
+						if ((grown = realloc (cell, sizeof (scenarioCell) * (cellCapacity * 2 + 64))) == NULL) {
+							printf ("%s:%d: OUT OF MEMORY\n", sourceName[i], lineNumber);
+							isOk = 0;
+							break;
+						}
+						cellList[n - 1] = cell = grown;
+						cellCapacity = cellCapacity * 2 + 64;
+					}
+					memset (&cell[cellTotal[n - 1]], 0, sizeof (scenarioCell));
+					cell[cellTotal[n - 1]].x = (int) rounded[0];
+					cell[cellTotal[n - 1]].y = (int) rounded[1];
+					cell[cellTotal[n - 1]].plane = plane;
+					cell[cellTotal[n - 1]].value = value + (endValue - value) * (length > 0 ? step / (double) length : 0);
+					cellTotal[n - 1]++;
+				}
+			}
+			else {
+				printf ("%s:%d: INVALID LINE %s\n", sourceName[i], lineNumber, line);
+				isOk = 0;
+			}
+		}
+		fclose (in);
+	}
+	if (isOk && n > 0 && foodCount != FOOD_NUM) {
+		printf ("SCENARIO %s HAS %d FOOD PATCHES, NOT %d\n", record[n - 1].name, foodCount, FOOD_NUM);
+		isOk = 0;
+	}
+	if (isOk && n > 0 && scenarioCheck (&record[n - 1], obstacleList[n - 1], obstacleTotal[n - 1]) == 0) {
+		isOk = 0;
+	}
+	if (isOk && n == 0) {
+		printf ("NO SCENARIOS\n");
+		isOk = 0;
+	}
+
+	if (isOk && (offset = malloc (sizeof (long long) * n)) == NULL) {
+		printf ("OUT OF MEMORY\n");
+		isOk = 0;
+	}
+
+	if (isOk) {
+		memset (&header, 0, sizeof (header));
+		memcpy (header.magic, "ASCN", 4);
+		header.version = SCENARIO_VERSION;
+		header.lMax = L_MAX;
+		header.colonyNum = COLONY_NUM;
+		header.foodNum = FOOD_NUM;
+		header.surroundingMode = SURROUNDING_MODE;
+		header.count = n;
+
+		/* records start 8-byte aligned */
+		position = sizeof (header) + sizeof (long long) * n;
+		for (i = 0; i < n; i++) {
+			offset[i] = (position + 7) / 8 * 8;
+			record[i].obstacleCount = obstacleTotal[i];
+			record[i].cellCount = cellTotal[i];
+			record[i].hash = cacheHash (&record[i], sizeof (scenarioRecord), 0xCBF29CE484222325ULL);
+			record[i].hash = cacheHash (obstacleList[i], sizeof (short) * 2 * obstacleTotal[i], record[i].hash);
+			record[i].hash = cacheHash (cellList[i], sizeof (scenarioCell) * cellTotal[i], record[i].hash);
+			position = offset[i] + sizeof (scenarioRecord) + sizeof (short) * 2 * obstacleTotal[i] + sizeof (scenarioCell) * cellTotal[i];
+		}
+
+		/* through a temporary file, so runs that have the old one mapped keep it */
+		snprintf (tempName, sizeof (tempName), "%s.tmp", libraryName);
+		if ((out = fopen (tempName, "wb")) == NULL) {
+			printf ("FAILED TO CREATE %s\n", tempName);
+			isOk = 0;
+		}
+		else {
+			fwrite (&header, sizeof (header), 1, out);
+			fwrite (offset, sizeof (long long), n, out);
+			for (i = 0; i < n; i++) {
+				while (ftell (out) < offset[i]) {
+					fputc (0, out);
+				}
+				fwrite (&record[i], sizeof (scenarioRecord), 1, out);
+				fwrite (obstacleList[i], sizeof (short) * 2, obstacleTotal[i], out);
+				fwrite (cellList[i], sizeof (scenarioCell), cellTotal[i], out);
+			}
+			isOk = fclose (out) == 0 && rename (tempName, libraryName) == 0;
+			if (isOk == 0) {
+				printf ("FAILED TO WRITE %s\n", libraryName);
+				remove (tempName);
+			}
+		}
+	}
+	if (isOk) {
+		printf ("%d scenario(s) in %s\n", n, libraryName);
+	}
+
+	for (i = 0; i < n; i++) {
+		free (obstacleList[i]);
+		free (cellList[i]);
+	}
+	free (record);
+	free (obstacleList);
+	free (cellList);
+	free (obstacleTotal);
+	free (cellTotal);
+	free (offset);
+
+	return isOk;
+}
+
+/* 1 if (x, y) is one of the total obstacle cells of the list */
+int scenarioIsObstacle (const short *obstacle, int total, int x, int y) {
+	int o;
+
+	for (o = 0; o < total; o++) {
+		if (obstacle[2 * o] == x && obstacle[2 * o + 1] == y) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/* Once a record is complete, none of its nests or food cells may lie on its obstacles, */
+/* whichever of the lines came first in the source */
+int scenarioCheck (const scenarioRecord *record, const short *obstacle, int total) {
+	int c, f;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		if (scenarioIsObstacle (obstacle, total, record->nest[c][0], record->nest[c][1])) {
+			printf ("SCENARIO %s: NEST %d AT %d %d IS AN OBSTACLE\n", record->name, c, record->nest[c][0], record->nest[c][1]);
+			return 0;
+		}
+	}
+	for (f = 0; f < (SURROUNDING_MODE == 0 ? FOOD_NUM : FOOD_NUM * 7); f++) {
+		if (scenarioIsObstacle (obstacle, total, record->food[f][0], record->food[f][1])) {
+			printf ("SCENARIO %s: FOOD AT %d %d IS AN OBSTACLE\n", record->name, record->food[f][0], record->food[f][1]);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* id, name and sizes of each scenario of a library */
+int scenarioList (const char *libraryName) {
+	const scenarioRecord *r;
+	int i, f;
+
+	if (scenarioOpen (libraryName) == 0) {
+		printf ("FAILED TO OPEN %s\n", libraryName);
+		return 0;
+	}
+
+	for (i = 0; i < scenarioCount; i++) {
+		r = scenarioFind (i);
+		printf ("%d %s: %d obstacle(s), %d pheromone cell(s), food at", i, r->name, r->obstacleCount, r->cellCount);
+		for (f = 0; f < FOOD_NUM; f++) {
+			printf (" (%d, %d)", r->food[SURROUNDING_MODE == 0 ? f : 7 * f][0], r->food[SURROUNDING_MODE == 0 ? f : 7 * f][1]);
+		}
+		printf ("\n");
+	}
+	return 1;
+}
+
+/* --------------------------- WARM START -------------------------------- */
+
+/* ANTS_WARM, or WARM_FILE; NULL for a cold start */
+const char *warmFileName () {
+	char *env = getenv ("ANTS_WARM");
+
+	if (env != NULL) {
+		return env[0] != '\0' ? env : NULL;
+	}
+	return WARM_FILE[0] != '\0' ? WARM_FILE : NULL;
+}
+
+/* Maps a saved field once for every run of this process, 0 if it cannot be used */
+int warmOpen (const char *fileName) {
+	const fieldHeader *header;
+	const double *field;
+	struct stat st;
+	size_t expected, i;
+	char *env;
+	void *map;
+	int fd;
+
+	if (warmMap != NULL) {
+		return 1;
+	}
+	if ((env = getenv ("ANTS_WARM_ANTS")) != NULL) {
+		doesWarmAnts = atoi (env);
+	}
+
+	if ((fd = open (fileName, O_RDONLY)) < 0 || fstat (fd, &st) != 0 || st.st_size < (off_t) sizeof (fieldHeader)
+		|| (map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		printf ("FAILED TO OPEN %s\n", fileName);
+		if (fd >= 0) {
+			close (fd);
+		}
+		return 0;
+	}
+	close (fd);
+
+	header = (const fieldHeader *) map;
+	field = (const double *) (header + 1);
+	expected = sizeof (fieldHeader) + FIELD_BYTES + (header->hasAnts ? sizeof (ant) * ANT_NUM + sizeof (int) * 2 * COLONY_NUM : 0);
+	if (memcmp (header->magic, "AFLD", 4) != 0 || header->version != FIELD_VERSION || (size_t) st.st_size != expected) {
+		printf ("INVALID FIELD %s\n", fileName);
+		munmap (map, st.st_size);
+		return 0;
+	}
+	if (header->lMax != L_MAX || header->speciesNum != SPECIES_NUM || header->antNum != ANT_NUM || header->colonyNum != COLONY_NUM) {
+		printf ("FIELD %s DOES NOT MATCH THIS BUILD\n", fileName);
+		munmap (map, st.st_size);
+		return 0;
+	}
+	for (i = 0; i < FIELD_BYTES / sizeof (double); i++) {
+		if (!isfinite (field[i])) {
+			printf ("INVALID FIELD %s\n", fileName);
+			munmap (map, st.st_size);
+			return 0;
+		}
+	}
+	if (doesWarmAnts && (header->hasAnts == 0 || ENGINE != 0)) {
+		printf ("NO ANTS IN %s, ONLY THE FIELD IS USED\n", fileName);
+		doesWarmAnts = 0;
+	}
+
+	warmMap = map;
+	warmSize = st.st_size;
+	warmHash = cacheHash (map, st.st_size, 0xCBF29CE484222325ULL);
+	return 1;
+}
+
+/* Saved pheromone on every cell that is open in this world too */
+void warmField () {
+	const double *field = (const double *) (warmMap + sizeof (fieldHeader));
+	int i, j, k;
+
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			if (isOpenCell (i, j) == 0) {
+				continue;
+			}
+			for (k = 0; k < 2 * SPECIES_NUM; k++) {
+				if (field[(i * (L_MAX * 2 + 1) + j) * 2 * SPECIES_NUM + k] > 0) {
+					pheromone[i][j][k] = field[(i * (L_MAX * 2 + 1) + j) * 2 * SPECIES_NUM + k];
+				}
+			}
+		}
+	}
+}
+
+/* Saved ants where they can still stand, with thresholds drawn for this run's parameters */
+void warmAnts () {
+	const ant *saved = (const ant *) (warmMap + sizeof (fieldHeader) + FIELD_BYTES);
+	const int *count = (const int *) (saved + ANT_NUM);
+	int a_n, c;
+
+	/* nothing read here is trusted to index an array */
+	for (c = 0; c < COLONY_NUM; c++) {
+		colonyList[c].count = count[2 * c] < 0 ? 0 : count[2 * c] > colonyList[c].population ? colonyList[c].population : count[2 * c];
+		colonyList[c].tempCount = count[2 * c + 1] < 0 ? 0 : count[2 * c + 1];
+	}
+
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		if (saved[a_n].colony != antList[a_n].colony || isOpenCell (saved[a_n].x, saved[a_n].y) == 0
+			|| saved[a_n].mode < 1 || saved[a_n].mode > 3 || saved[a_n].direction < 0 || saved[a_n].direction > 5) {
+			continue;
+		}
+		antList[a_n].x = saved[a_n].x;
+		antList[a_n].y = saved[a_n].y;
+		antList[a_n].direction = saved[a_n].direction;
+		antList[a_n].mode = saved[a_n].mode;
+		antList[a_n].vitality = saved[a_n].vitality;
+		antList[a_n].hasFood = saved[a_n].hasFood != 0;
+		antList[a_n].hasComeBack = saved[a_n].hasComeBack != 0;
+	}
+}
+
+/* ANTS_SAVE_FIELD=1 saves the final field without recompiling */
+void warmSaveInitialization () {
+	char *env = getenv ("ANTS_SAVE_FIELD");
+
+	if (env != NULL) {
+		doesSaveField = atoi (env);
+	}
+}
+
+/* Writes <run>.field, the field and ants as they are now */
+void warmSave () {
+	fieldHeader header;
+	char fileName[48];
+	FILE *fp;
+	int c;
+
+	if (doesSaveField == 0 || doesWrite == 0) {
+		return;
+	}
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, "AFLD", 4);
+	header.version = FIELD_VERSION;
+	header.lMax = L_MAX;
+	header.speciesNum = SPECIES_NUM;
+	header.antNum = ANT_NUM;
+	header.colonyNum = COLONY_NUM;
+	/* steps run so far */
+	header.step = procedureCount + 1;
+	header.hasAnts = ENGINE == 0;
+
+	sprintf (fileName, "%s.field", runName);
+	if ((fp = fopen (fileName, "wb")) == NULL) {
+		printf ("FAILED TO CREATE FILE");
+		return;
+	}
+	fwrite (&header, sizeof (header), 1, fp);
+	fwrite (pheromone, FIELD_BYTES, 1, fp);
+	if (header.hasAnts) {
+		fwrite (antList, sizeof (ant), ANT_NUM, fp);
+		for (c = 0; c < COLONY_NUM; c++) {
+			fwrite (&colonyList[c].count, sizeof (int), 1, fp);
+			fwrite (&colonyList[c].tempCount, sizeof (int), 1, fp);
+		}
+	}
+	fclose (fp);
+}
+
+/* ---------------------------- CHECKPOINT ------------------------------- */
+
+/* Everything a step depends on, in file order */
+/* coordinate comes from honeyCombInitialization and is not saved */
+/* -1 if there are more than capacity sections */
+int checkpointSections (void *section[], size_t size[], int capacity) {
+	int n = 0;
+
+# define CHECKPOINT_SECTION(a) do { if (n == capacity) return -1; section[n] = (void *) &(a); size[n] = sizeof (a); n++; } while (0)
+# define CHECKPOINT_ARENA(a, count) do { if (n == capacity) return -1; section[n] = (void *) (a); size[n] = sizeof (*(a)) * (count); n++; } while (0)
+	CHECKPOINT_SECTION (runName);
+	CHECKPOINT_SECTION (param);
+	CHECKPOINT_ARENA (pheromone, L_MAX * 2 + 1);
+	CHECKPOINT_ARENA (tempPheromone, L_MAX * 2 + 1);
+	CHECKPOINT_ARENA (obstaclePlace, L_MAX * 2 + 1);
+	CHECKPOINT_ARENA (passableMask, L_MAX * 2 + 1);
+	CHECKPOINT_SECTION (foodPos);
+	CHECKPOINT_ARENA (antList, ANT_NUM);
+	CHECKPOINT_SECTION (colonyList);
+	CHECKPOINT_SECTION (homingProb);
+	CHECKPOINT_SECTION (homingNum);
+	CHECKPOINT_SECTION (convergeLastHoming);
+	CHECKPOINT_SECTION (convergeLastField);
+	CHECKPOINT_SECTION (convergeStable);
+	CHECKPOINT_SECTION (seriesStep);
+	CHECKPOINT_SECTION (seriesHomingProb);
+	CHECKPOINT_SECTION (seriesHomingNum);
+	CHECKPOINT_SECTION (seriesTotalAnt);
+	CHECKPOINT_SECTION (phaseTime);
+	CHECKPOINT_SECTION (eventCount);
+	CHECKPOINT_SECTION (profileSteps);
+
+	if (ENGINE == 1) {
+		CHECKPOINT_ARENA (density, COLONY_NUM);
+		CHECKPOINT_ARENA (foodPlace, L_MAX * 2 + 1);
+		CHECKPOINT_SECTION (meanFieldComeBack);
+		CHECKPOINT_SECTION (meanFieldTotal);
+		CHECKPOINT_SECTION (meanFieldRespawn);
+		CHECKPOINT_SECTION (meanFieldEvent);
+	}
+# undef CHECKPOINT_SECTION
+# undef CHECKPOINT_ARENA
+
+	return n;
+}
+
+/* Writes <seed>.ckpt through a temporary file, so a crash keeps the last one */
+void checkpointWrite (int step) {
+	checkpointHeader header;
+	void *section[CHECKPOINT_SECTION_MAX];
+	size_t size[CHECKPOINT_SECTION_MAX];
+	char fileName[48], tempName[56];
+	FILE *fp;
+	int i, isOk;
+
+	if (doesWrite == 0) {
+		return;
+	}
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, "ACKP", 4);
+	header.version = CHECKPOINT_VERSION;
+	header.lMax = L_MAX;
+	header.antNum = ANT_NUM;
+	header.colonyNum = COLONY_NUM;
+	header.speciesNum = SPECIES_NUM;
+	header.foodCount = SURROUNDING_MODE == 0 ? FOOD_NUM : FOOD_NUM * 7;
+	header.engine = ENGINE;
+	header.seed = seed;
+	header.step = step;
+	header.sectionCount = checkpointSections (section, size, CHECKPOINT_SECTION_MAX);
+	if (header.sectionCount < 0) {
+		printf ("TOO MANY CHECKPOINT SECTIONS\n");
+		return;
+	}
+	header.seriesRows = seriesRows;
+	header.randomState = randomState;
+
+	/* the rows still in the buffer are saved, the file keeps only whole blocks */
+	header.seriesOffset = -1;
+	if (seriesFile != NULL) {
+		fflush (seriesFile);
+		header.seriesOffset = ftell (seriesFile);
+	}
+
+	header.size = sizeof (header);
+	for (i = 0; i < header.sectionCount; i++) {
+		header.size += size[i];
+	}
+
+	sprintf (fileName, "%s.ckpt", runName);
+	sprintf (tempName, "%s.tmp", fileName);
+
+	if ((fp = fopen (tempName, "wb")) == NULL) {
+		printf ("FAILED TO CREATE CHECKPOINT\n");
+		return;
+	}
+
+	isOk = fwrite (&header, sizeof (header), 1, fp) == 1;
+	for (i = 0; i < header.sectionCount; i++) {
+		isOk = isOk && fwrite (section[i], size[i], 1, fp) == 1;
+	}
+	isOk = fclose (fp) == 0 && isOk;
+
+	if (isOk == 0 || rename (tempName, fileName) != 0) {
+		printf ("FAILED TO CREATE CHECKPOINT\n");
+		remove (tempName);
+	}
+}
+
+/* Maps a checkpoint and copies it back, returns the step to go on from or -1 */
+int checkpointResume (const char *fileName) {
+	const checkpointHeader *header;
+	void *section[CHECKPOINT_SECTION_MAX];
+	size_t size[CHECKPOINT_SECTION_MAX];
+	long long resumedPhaseTime[PHASE_NUM], resumedEventCount[EVENT_NUM];
+	struct stat st;
+	const char *p;
+	void *map;
+	int fd, i, n, step, resumedSteps;
+	long long expected;
+
+	if ((fd = open (fileName, O_RDONLY)) < 0 || fstat (fd, &st) != 0) {
+		printf ("FAILED TO OPEN %s\n", fileName);
+		return -1;
+	}
+	if (st.st_size < (off_t) sizeof (checkpointHeader)) {
+		printf ("INVALID CHECKPOINT %s\n", fileName);
+		close (fd);
+		return -1;
+	}
+
+	map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close (fd);
+	if (map == MAP_FAILED) {
+		printf ("FAILED TO OPEN %s\n", fileName);
+		return -1;
+	}
+	header = (const checkpointHeader *) map;
+
+	if ((n = checkpointSections (section, size, CHECKPOINT_SECTION_MAX)) < 0) {
+		printf ("TOO MANY CHECKPOINT SECTIONS\n");
+		munmap (map, st.st_size);
+		return -1;
+	}
+	expected = sizeof (checkpointHeader);
+	for (i = 0; i < n; i++) {
+		expected += size[i];
+	}
+
+	if (memcmp (header->magic, "ACKP", 4) != 0 || header->version != CHECKPOINT_VERSION) {
+		printf ("INVALID CHECKPOINT %s\n", fileName);
+		munmap (map, st.st_size);
+		return -1;
+	}
+	if (header->lMax != L_MAX || header->antNum != ANT_NUM || header->colonyNum != COLONY_NUM || header->speciesNum != SPECIES_NUM || header->foodCount != (SURROUNDING_MODE == 0 ? FOOD_NUM : FOOD_NUM * 7) || header->engine != ENGINE || header->sectionCount != n || header->size != expected || st.st_size != expected) {
+		printf ("CHECKPOINT %s DOES NOT MATCH THIS BUILD\n", fileName);
+		munmap (map, st.st_size);
+		return -1;
+	}
+
+	seed = header->seed;
+	step = header->step;
+	randomState = header->randomState;
+	startingTime = (unsigned) time (NULL);
+
+	p = (const char *) map + sizeof (checkpointHeader);
+	for (i = 0; i < n; i++) {
+		memcpy (section[i], p, size[i]);
+		p += size[i];
+	}
+
+	/* profileInitialization starts from zero, the profile goes on from the checkpoint */
+	memcpy (resumedPhaseTime, phaseTime, sizeof (phaseTime));
+	memcpy (resumedEventCount, eventCount, sizeof (eventCount));
+	resumedSteps = profileSteps;
+
+	profileInitialization ();
+
+	memcpy (phaseTime, resumedPhaseTime, sizeof (phaseTime));
+	memcpy (lastPhaseTime, resumedPhaseTime, sizeof (phaseTime));
+	memcpy (eventCount, resumedEventCount, sizeof (eventCount));
+	memcpy (lastEventCount, resumedEventCount, sizeof (eventCount));
+	profileSteps = resumedSteps;
+	lastProfileStep = step;
+	honeyCombInitialization ();
+
+	/* cut the series back to where it was and keep appending */
+	seriesRows = header->seriesRows;
+	sprintf (seriesFileName, "%s.series", runName);
+	seriesFile = NULL;
+	if (header->seriesOffset >= 0) {
+		if ((seriesFile = fopen (seriesFileName, "r+b")) == NULL || ftruncate (fileno (seriesFile), header->seriesOffset) != 0) {
+			printf ("FAILED TO REOPEN %s\n", seriesFileName);
+			if (seriesFile != NULL) {
+				fclose (seriesFile);
+				seriesFile = NULL;
+			}
+		}
+		else {
+			fseek (seriesFile, 0, SEEK_END);
+		}
+	}
+
+	munmap (map, st.st_size);
+	fieldStatUpdate ();
+
+	if (doesDraw) {
+		renderStart ();
+	}
+
+	return step;
+}
+
+/* ------------------------------ BRANCH --------------------------------- */
+
+/* The field of param called name, NULL if there is none */
+double *parameterField (const char *name) {
+	const char *names[] = {
+		"thresholdOneSensitive", "thresholdOneInsensitive",
+		"thresholdTwoSensitive", "thresholdTwoInsensitive",
+		"pheromoneReleaseOne", "pheromoneReleaseTwo",
+		"diffusionCoefOne", "evaporateCoefOne",
+		"diffusionCoefTwo", "evaporateCoefTwo",
+		"convergeWindow", "convergeTolerance",
+		"convergeFieldTolerance", "convergePatience",
+		"scenario",
+	};
+	double *fields[] = {
+		&param.thresholdOneSensitive, &param.thresholdOneInsensitive,
+		&param.thresholdTwoSensitive, &param.thresholdTwoInsensitive,
+		&param.pheromoneReleaseOne, &param.pheromoneReleaseTwo,
+		&param.diffusionCoefOne, &param.evaporateCoefOne,
+		&param.diffusionCoefTwo, &param.evaporateCoefTwo,
+		&param.convergeWindow, &param.convergeTolerance,
+		&param.convergeFieldTolerance, &param.convergePatience,
+		&param.scenario,
+	};
+	int i;
+
+	for (i = 0; i < (int) (sizeof (names) / sizeof (names[0])); i++) {
+		if (strcmp (name, names[i]) == 0) {
+			return fields[i];
+		}
+	}
+	return NULL;
+}
+
+/* Sets "name=value,name=value", returns 0 on a bad delta */
+/* "-" or an empty string keeps every parameter */
+int parameterApply (const char *delta) {
+	char name[64];
+	double value, *field;
+	int n;
+
+	if (strcmp (delta, "-") == 0) {
+		return 1;
+	}
+
+	while (*delta != '\0') {
+		if (sscanf (delta, "%63[^=,]=%lf%n", name, &value, &n) != 2 || (field = parameterField (name)) == NULL) {
+			printf ("INVALID DELTA %s\n", delta);
+			return 0;
+		}
+		*field = value;
+
+		delta += n;
+		if (*delta == ',') {
+			delta++;
+		}
+		else if (*delta != '\0') {
+			printf ("INVALID DELTA %s\n", delta);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/* Runs the warm-up once, then forks one child per delta, one per core at a time */
+/* children share the warm-up state copy-on-write and never write it back */
+int branchRun (int steps, int count, char *delta[]) {
+	parameter base = param;
+	int b, status, running = 0, failure = 0;
+	long cores = sysconf (_SC_NPROCESSORS_ONLN);
+	pid_t pid;
+
+	for (b = 0; b < count; b++) {
+		if (parameterApply (delta[b]) == 0) {
+			return 1;
+		}
+		param = base;
+	}
+	if (steps < 0 || steps > MAX_PROCEDURE) {
+		printf ("INVALID WARM-UP %d\n", steps);
+		return 1;
+	}
+
+	doesDraw = 0;
+	isQuiet = 1;
+
+	/* sysconf may not know, and waiting with no child running never returns a status */
+	if (cores < 1) {
+		cores = 1;
+	}
+
+	/* the writer threads would not survive fork */
+	doesTrajectory = 0;
+	heatmapInterval = 0;
+
+	initialization ();
+	if (ENGINE == 1) {
+		meanFieldInitialization ();
+		meanFieldMovement (0, steps);
+	}
+	else {
+		consecutiveMovement (0, steps);
+	}
+
+	/* a settled warm-up stopped short of steps, and its branches would stop at once */
+	if (stopStep >= 0) {
+		printf ("WARM-UP CONVERGED AT %d\n", stopStep);
+		telemetryClose ();
+		return 1;
+	}
+
+	/* nothing buffered may be written twice */
+	fflush (NULL);
+
+	for (b = 0; b < count; b++) {
+		if (running >= cores) {
+			wait (&status);
+			failure += WIFEXITED (status) == 0 || WEXITSTATUS (status) != 0;
+			running--;
+		}
+
+		if ((pid = fork ()) == 0) {
+			branchChild (b, delta[b], steps);
+			exit (0);
+		}
+		if (pid < 0) {
+			printf ("FAILED TO FORK BRANCH %d\n", b);
+			failure++;
+			continue;
+		}
+		running++;
+	}
+
+	while (running > 0) {
+		wait (&status);
+		failure += WIFEXITED (status) == 0 || WEXITSTATUS (status) != 0;
+		running--;
+	}
+
+	/* <seed>.series keeps the warm-up only */
+	seriesClose ();
+	telemetryClose ();
+
+	return failure;
+}
+
+/* Applies the delta on its own random stream and finishes the run as <seed>-<b> */
+void branchChild (int b, const char *delta, int steps) {
+	char parentName[48];
+	int a_n, c;
+
+	sprintf (runName, "%d-%d", seed, b);
+	isCacheable = 0;
+
+	/* getrusage counts from zero again in the child */
+	worldArena.faults = arenaFaults ();
+	parameterApply (delta);
+	randomSeed (((unsigned long long) seed << 32) + b + 1);
+
+	/* the new parameters settle on their own */
+	convergeStable = 0;
+
+	/* ants already out take the new thresholds of their class as well */
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		if (antList[a_n].isSensitive) {
+			antList[a_n].threshold[0] = param.thresholdOneSensitive;
+			antList[a_n].threshold[1] = param.thresholdTwoSensitive;
+		}
+		else {
+			antList[a_n].threshold[0] = param.thresholdOneInsensitive;
+			antList[a_n].threshold[1] = param.thresholdTwoInsensitive;
+		}
+	}
+
+	if (profileFile != NULL) {
+		fclose (profileFile);
+		profileFile = NULL;
+	}
+	profileInitialization ();
+
+	/* the parent's segment stays the parent's; the branch publishes its own */
+	if (telemetry != NULL) {
+		munmap (telemetry, sizeof (telemetrySegment));
+		telemetry = NULL;
+	}
+	telemetryInitialization ();
+
+	strcpy (parentName, seriesFileName);
+	if (seriesFile != NULL) {
+		seriesBranch (parentName);
+	}
+
+	if (ENGINE == 1) {
+		meanFieldMovement (steps, MAX_PROCEDURE);
+	}
+	else {
+		consecutiveMovement (steps, MAX_PROCEDURE);
+	}
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		printf ("%s: %d / %d\n", runName, colonyList[c].comeBack, colonyList[c].totalAnt);
+	}
+
+	telemetryClose ();
+	createAndWriteInFile ();
+	profileSummary ();
+}
+
+/* ------------------------------ SWEEP ---------------------------------- */
+
+/* Runs a sweep spec on worker processes, in rounds until every set is narrow enough */
+int sweepRun (const char *specName, const char *csvName, int workers) {
+	long cores = sysconf (_SC_NPROCESSORS_ONLN);
+	size_t rangeSize, resultSize, statSize, lockSize;
+	ensembleStat final;
+	int *done;
+	int set, k, round, scheduled, lost, progress, failure = 0;
+
+	if (sweepParse (specName) == 0) {
+		return 1;
+	}
+	if (cores < 1) {
+		cores = 1;
+	}
+	if (workers <= 0) {
+		workers = cores;
+	}
+
+	/* antithetic pairs are never split between rounds */
+	if (sweepAntithetic) {
+		sweepSeeds += sweepSeeds % 2;
+	}
+	if (sweepMaxSeeds < sweepSeeds) {
+		sweepMaxSeeds = sweepSeeds;
+	}
+	if (sweepAntithetic) {
+		sweepMaxSeeds += sweepMaxSeeds % 2;
+	}
+
+	/* shared pages, everything else is private to each worker after fork */
+	rangeSize = sizeof (unsigned long long) * workers;
+	resultSize = sizeof (sweepResult) * sweepSetNum * sweepMaxSeeds;
+	statSize = sizeof (ensembleStat) * sweepSetNum * ENSEMBLE_POINTS;
+	lockSize = sizeof (int) * sweepSetNum;
+	sweepRange = mmap (NULL, rangeSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	sweepResultList = mmap (NULL, resultSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	sweepStat = mmap (NULL, statSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	sweepLock = mmap (NULL, lockSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	sweepJobList = malloc (sizeof (int) * sweepSetNum * sweepMaxSeeds);
+	done = calloc (sweepSetNum, sizeof (int));
+	if (sweepRange == MAP_FAILED || sweepResultList == MAP_FAILED || sweepStat == MAP_FAILED || sweepLock == MAP_FAILED || sweepJobList == NULL || done == NULL) {
+		printf ("FAILED TO MAP SWEEP\n");
+		return 1;
+	}
+
+	for (k = 0; k < sweepSetNum * sweepMaxSeeds; k++) {
+		sweepResultList[k].status = -1;
+	}
+
+	for (round = 0; ; round++) {
+		/* sets still too wide get one more batch */
+		sweepJobNum = 0;
+		for (set = 0; set < sweepSetNum; set++) {
+			if (done[set] > 0) {
+				ensembleFinal (set, done[set], &final);
+				if (sweepCiWidth <= 0 || (final.n >= 2 && 2 * ensembleHalfWidth (&final) <= sweepCiWidth)) {
+					continue;
+				}
+			}
+			for (k = done[set]; k < done[set] + sweepSeeds && k < sweepMaxSeeds; k++) {
+				sweepJobList[sweepJobNum++] = set * sweepMaxSeeds + k;
+			}
+		}
+		if (sweepJobNum == 0) {
+			break;
+		}
+
+		scheduled = workers < sweepJobNum ? workers : sweepJobNum;
+		printf ("round %d: %d runs on %d workers\n", round, sweepJobNum, scheduled);
+		fflush (NULL);
+		lost = sweepSchedule (scheduled);
+		failure += lost;
+
+		progress = 0;
+		for (set = 0; set < sweepSetNum; set++) {
+			for (k = done[set]; k < done[set] + sweepSeeds && k < sweepMaxSeeds && sweepResultList[set * sweepMaxSeeds + k].status >= 0; k++) {
+			}
+			progress += k - done[set];
+			done[set] = k;
+		}
+
+		/* the same jobs would only be scheduled again */
+		if (lost == scheduled) {
+			printf ("NO WORKER COULD BE FORKED\n");
+			failure++;
+			break;
+		}
+		if (progress == 0) {
+			printf ("SWEEP ROUND %d FINISHED NO RUN\n", round);
+			failure++;
+			break;
+		}
+	}
+
+	for (k = 0; k < sweepSetNum * sweepMaxSeeds; k++) {
+		failure += sweepResultList[k].status > 0;
+	}
+
+	if (sweepWrite (csvName) == 0 || ensembleWrite (csvName, done) == 0) {
+		failure++;
+	}
+
+	munmap (sweepRange, rangeSize);
+	munmap (sweepResultList, resultSize);
+	munmap (sweepStat, statSize);
+	munmap (sweepLock, lockSize);
+	free (sweepJobList);
+	free (sweepSet);
+	free (done);
+
+	return failure;
+}
+
+/* Runs sweepJobList on workers, returns how many could not be forked */
+int sweepSchedule (int workers) {
+	int w, status, failure = 0;
+	pid_t pid;
+
+	/* contiguous ranges, so neighbouring sets of similar length start on one worker */
+	for (w = 0; w < workers; w++) {
+		sweepRange[w] = ((unsigned long long) (sweepJobNum * (long long) w / workers) << 32) | (unsigned) (sweepJobNum * (long long) (w + 1) / workers);
+	}
+
+	for (w = 0; w < workers; w++) {
+		if ((pid = fork ()) == 0) {
+			sweepWorker (w, workers);
+			exit (0);
+		}
+		if (pid < 0) {
+			printf ("FAILED TO FORK WORKER %d\n", w);
+			failure++;
+		}
+	}
+	while (wait (&status) > 0) {
+	}
+
+	return failure;
+}
+
+/* Spec lines: "seeds <n>", "seed <first>", "maxSeeds <n>", "ci <width>", */
+/* "crn <0 or 1>", "antithetic <0 or 1>", or a delta to expand */
+/* "name=a:b:c,name=d:e" in a delta is a grid of every combination */
+int sweepParse (const char *specName) {
+	FILE *fp;
+	char line[1024];
+	parameter base = param;
+	int isOk = 1;
+
+	if ((fp = fopen (specName, "r")) == NULL) {
+		printf ("FAILED TO OPEN %s\n", specName);
+		return 0;
+	}
+	if ((sweepSet = malloc (sizeof (parameter) * SWEEP_SET_MAX)) == NULL) {
+		fclose (fp);
+		return 0;
+	}
+
+	sweepSetNum = 0;
+	while (isOk && fgets (line, sizeof (line), fp) != NULL) {
+		line[strcspn (line, "\r\n#")] = '\0';
+		if (sscanf (line, " seeds %d", &sweepSeeds) == 1 || sscanf (line, " seed %d", &sweepFirstSeed) == 1 || sscanf (line, " maxSeeds %d", &sweepMaxSeeds) == 1 || sscanf (line, " ci %lf", &sweepCiWidth) == 1 || sscanf (line, " crn %d", &sweepCrn) == 1 || sscanf (line, " antithetic %d", &sweepAntithetic) == 1) {
+			continue;
+		}
+		if (strspn (line, " \t") == strlen (line)) {
+			continue;
+		}
+		isOk = sweepExpand (line + strspn (line, " \t"), &base);
+	}
+	fclose (fp);
+
+	if (isOk && (sweepSetNum == 0 || sweepSeeds <= 0 || sweepFirstSeed < 0)) {
+		printf ("EMPTY SWEEP %s\n", specName);
+		isOk = 0;
+	}
+	return isOk;
+}
+
+/* Adds every combination of one delta line to sweepSet */
+int sweepExpand (char *line, const parameter *base) {
+	char delta[1024], *item[32], *value[32][32], *p;
+	int count[32], choice[32];
+	int i, n = 0, k;
+
+	line[strcspn (line, " \t")] = '\0';
+
+	/* item[i] is "name", value[i] are its values */
+	if (strcmp (line, "-") != 0) {
+		for (p = strtok (line, ","); p != NULL; p = strtok (NULL, ",")) {
+			if (n == 32 || strchr (p, '=') == NULL) {
+				printf ("INVALID DELTA %s\n", p);
+				return 0;
+			}
+			item[n++] = p;
+		}
+	}
+	for (i = 0; i < n; i++) {
+		p = strchr (item[i], '=');
+		*p = '\0';
+		count[i] = 0;
+		choice[i] = 0;
+		for (p = strtok (p + 1, ":"); p != NULL && count[i] < 32; p = strtok (NULL, ":")) {
+			value[i][count[i]++] = p;
+		}
+		if (count[i] == 0) {
+			printf ("INVALID DELTA %s\n", item[i]);
+			return 0;
+		}
+	}
+
+	do {
+		if (sweepSetNum == SWEEP_SET_MAX) {
+			printf ("MORE THAN %d SETS\n", SWEEP_SET_MAX);
+			return 0;
+		}
+
+		k = 0;
+		delta[0] = '\0';
+		for (i = 0; i < n; i++) {
+			k += snprintf (delta + k, sizeof (delta) - k, "%s%s=%s", i == 0 ? "" : ",", item[i], value[i][choice[i]]);
+		}
+
+		param = *base;
+		if (parameterApply (delta) == 0) {
+			return 0;
+		}
+		sweepSet[sweepSetNum++] = param;
+
+		/* next combination, the last name changes fastest */
+		for (i = n - 1; i >= 0 && ++choice[i] == count[i]; i--) {
+			choice[i] = 0;
+		}
+	} while (i >= 0);
+
+	param = *base;
+	return 1;
+}
+
+/* Next job of worker w, stolen from another worker when its own range is empty */
+int sweepTake (int w, int workers) {
+	unsigned long long range, next;
+	int v, k;
+
+	for (k = 0; k < workers; k++) {
+		v = (w + k) % workers;
+		range = __atomic_load_n (&sweepRange[v], __ATOMIC_ACQUIRE);
+
+		while ((unsigned) (range >> 32) < (unsigned) range) {
+			if (k == 0) {
+				next = range + (1ULL << 32);
+			}
+			else {
+				next = range - 1;
+			}
+			if (__atomic_compare_exchange_n (&sweepRange[v], &range, next, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+				return k == 0 ? (int) (range >> 32) : (int) (unsigned) next;
+			}
+		}
+	}
+	return -1;
+}
+
+/* Pinned to a core, runs jobs in forked children so every run starts clean */
+void sweepWorker (int w, int workers) {
+	long cores = sysconf (_SC_NPROCESSORS_ONLN);
+	long long start;
+	int j, k, status;
+	pid_t pid;
+# ifdef CPU_SET
+	cpu_set_t set;
+
+	if (cores < 1) {
+		cores = 1;
+	}
+	CPU_ZERO (&set);
+	CPU_SET (w % cores, &set);
+	sched_setaffinity (0, sizeof (set), &set);
+# endif
+
+	while ((j = sweepTake (w, workers)) >= 0) {
+		k = sweepJobList[j];
+		start = profileClock ();
+
+		if ((pid = fork ()) == 0) {
+			sweepJob (k);
+			exit (0);
+		}
+		if (pid < 0 || waitpid (pid, &status, 0) != pid || WIFEXITED (status) == 0 || WEXITSTATUS (status) != 0) {
+			sweepResultList[k].status = 1;
+			printf ("RUN %d FAILED\n", k);
+		}
+
+		sweepResultList[k].seconds = (profileClock () - start) / 1e9;
+	}
+}
+
+/* One run without window or files, merged into its set's statistics */
+void sweepJob (int k) {
+	int set = k / sweepMaxSeeds;
+	int replicate = k % sweepMaxSeeds;
+	double trace[ENSEMBLE_POINTS];
+	char label[32];
+	cacheKey key;
+	cacheRecord record;
+	int c, i;
+
+	param = sweepSet[set];
+	requestedSeed = sweepSeedOf (set, replicate);
+	isAntithetic = sweepAntithetic && replicate % 2 == 1;
+	doesDraw = 0;
+	isQuiet = 1;
+	doesWrite = 0;
+	ensembleTrace = trace;
+
+	/* sets can share seeds, so a run is named after its index */
+	sprintf (label, "sweep%d", k);
+	runLabel = label;
+
+	cacheKeyFill (&key, requestedSeed);
+	sweepResultList[k].isCached = cacheEnabled () && cacheLoad (&key, &record, trace);
+
+	if (sweepResultList[k].isCached) {
+		seed = requestedSeed;
+		cacheRestore (&record);
+	}
+	else {
+		initialization ();
+		if (ENGINE == 1) {
+			meanFieldInitialization ();
+			meanFieldMovement (0, MAX_PROCEDURE);
+		}
+		else {
+			consecutiveMovement (0, MAX_PROCEDURE);
+		}
+		telemetryClose ();
+		ensembleTraceFinish ();
+
+		if (cacheEnabled ()) {
+			cacheStore (&key, trace, NULL);
+		}
+	}
+	runLabel = NULL;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		sweepResultList[k].comeBack[c] = colonyList[c].comeBack;
+		sweepResultList[k].totalAnt[c] = colonyList[c].totalAnt;
+	}
+	sweepResultList[k].seed = seed;
+	sweepResultList[k].isAntithetic = isAntithetic;
+	sweepResultList[k].homing = totalComeBack () / (double) totalAntCount ();
+	sweepResultList[k].stopStep = stopStep;
+	sweepResultList[k].stopReason = stopReason;
+
+	while (__atomic_exchange_n (&sweepLock[set], 1, __ATOMIC_ACQUIRE)) {
+		sched_yield ();
+	}
+	for (i = 0; i < ENSEMBLE_POINTS && i * ENSEMBLE_INTERVAL < MAX_PROCEDURE; i++) {
+		ensembleAdd (&sweepStat[set * ENSEMBLE_POINTS + i], trace[i]);
+	}
+	__atomic_store_n (&sweepLock[set], 0, __ATOMIC_RELEASE);
+
+	sweepResultList[k].status = 0;
+}
+
+/* With crn every set shares seeds; an antithetic pair shares one seed */
+int sweepSeedOf (int set, int replicate) {
+	int first = sweepFirstSeed + (sweepCrn ? 0 : set * sweepMaxSeeds);
+
+	return first + (sweepAntithetic ? replicate / 2 : replicate);
+}
+
+/* One row per run: set, seed, parameters, homing of each colony and time */
+int sweepWrite (const char *csvName) {
+	FILE *fp;
+	parameter *q;
+	sweepResult *r;
+	int k, c;
+
+	if ((fp = fopen (csvName, "w")) == NULL) {
+		printf ("FAILED TO CREATE FILE");
+		return 0;
+	}
+
+	fprintf (fp, "set,seed,antithetic,thresholdOneSensitive,thresholdOneInsensitive,thresholdTwoSensitive,thresholdTwoInsensitive,pheromoneReleaseOne,pheromoneReleaseTwo,diffusionCoefOne,evaporateCoefOne,diffusionCoefTwo,evaporateCoefTwo,scenario");
+	for (c = 0; c < COLONY_NUM; c++) {
+		fprintf (fp, ",comeBack%d,totalAnt%d,homingProb%d", c, c, c);
+	}
+	fprintf (fp, ",stopStep,stopReason,cached,status,seconds\n");
+
+	for (k = 0; k < sweepSetNum * sweepMaxSeeds; k++) {
+		r = &sweepResultList[k];
+		if (r->status < 0) {
+			continue;
+		}
+
+		q = &sweepSet[k / sweepMaxSeeds];
+		fprintf (fp, "%d,%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%.10le,%lf,%.10le,%lf,%d", k / sweepMaxSeeds, r->seed, r->isAntithetic, q->thresholdOneSensitive, q->thresholdOneInsensitive, q->thresholdTwoSensitive, q->thresholdTwoInsensitive, q->pheromoneReleaseOne, q->pheromoneReleaseTwo, q->diffusionCoefOne, q->evaporateCoefOne, q->diffusionCoefTwo, q->evaporateCoefTwo, (int) q->scenario);
+		for (c = 0; c < COLONY_NUM; c++) {
+			fprintf (fp, ",%d,%d,%lf", r->comeBack[c], r->totalAnt[c], r->totalAnt[c] > 0 ? r->comeBack[c] / (double) r->totalAnt[c] : 0.0);
+		}
+		fprintf (fp, ",%d,%s,%d,%d,%lf\n", r->stopStep, r->status == 0 ? stopReasonName[r->stopReason] : "failed", r->isCached, r->status, r->seconds);
+	}
+
+	fclose (fp);
+	return 1;
+}
+
+/* ----------------------------- ENSEMBLE -------------------------------- */
+
+/* Welford's update, stable however many runs are added */
+void ensembleAdd (ensembleStat *stat, double x) {
+	double d = x - stat->mean;
+
+	stat->n++;
+	stat->mean += d / stat->n;
+	stat->m2 += d * (x - stat->mean);
+}
+
+/* Sample standard deviation */
+double ensembleDeviation (const ensembleStat *stat) {
+	if (stat->n < 2) {
+		return 0;
+	}
+	return sqrt (stat->m2 / (stat->n - 1));
+}
+
+/* Half width of the 95% confidence interval of the mean, Student's t */
+double ensembleHalfWidth (const ensembleStat *stat) {
+	const double t[30] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+	};
+
+	if (stat->n < 2) {
+		return INFINITY;
+	}
+	return (stat->n <= 31 ? t[stat->n - 2] : 1.960) * ensembleDeviation (stat) / sqrt (stat->n);
+}
+
+/* Final homing probability of the first done replicates of a set */
+/* an antithetic pair counts as one sample, the mean of the two */
+void ensembleFinal (int set, int done, ensembleStat *stat) {
+	sweepResult *r = &sweepResultList[set * sweepMaxSeeds];
+	int k;
+
+	memset (stat, 0, sizeof (ensembleStat));
+	for (k = 0; k < done; k += sweepAntithetic ? 2 : 1) {
+		if (sweepAntithetic) {
+			if (k + 1 < done && r[k].status == 0 && r[k + 1].status == 0) {
+				ensembleAdd (stat, (r[k].homing + r[k + 1].homing) / 2);
+			}
+		}
+		else if (r[k].status == 0) {
+			ensembleAdd (stat, r[k].homing);
+		}
+	}
+}
+
+/* <csv>.ensemble.csv has one row per set, <csv>.steps.csv the mean curve of each */
+int ensembleWrite (const char *csvName, int done[]) {
+	FILE *fp;
+	ensembleStat final, *stat;
+	char stem[256], fileName[300];
+	double half;
+	int set, i;
+
+	snprintf (stem, sizeof (stem), "%s", csvName);
+	if (strlen (stem) > 4 && strcmp (stem + strlen (stem) - 4, ".csv") == 0) {
+		stem[strlen (stem) - 4] = '\0';
+	}
+
+	sprintf (fileName, "%s.ensemble.csv", stem);
+	if ((fp = fopen (fileName, "w")) == NULL) {
+		printf ("FAILED TO CREATE FILE");
+		return 0;
+	}
+	fprintf (fp, "set,runs,samples,mean,deviation,ciLow,ciHigh,isNarrow\n");
+	for (set = 0; set < sweepSetNum; set++) {
+		ensembleFinal (set, done[set], &final);
+		half = ensembleHalfWidth (&final);
+		fprintf (fp, "%d,%d,%lld,%lf,%lf,%lf,%lf,%d\n", set, done[set], final.n, final.mean, ensembleDeviation (&final), final.mean - half, final.mean + half, sweepCiWidth > 0 && 2 * half <= sweepCiWidth);
+	}
+	fclose (fp);
+
+	sprintf (fileName, "%s.steps.csv", stem);
+	if ((fp = fopen (fileName, "w")) == NULL) {
+		printf ("FAILED TO CREATE FILE");
+		return 0;
+	}
+	fprintf (fp, "set,t,runs,mean,deviation\n");
+	for (set = 0; set < sweepSetNum; set++) {
+		for (i = 0; i < ENSEMBLE_POINTS && i * ENSEMBLE_INTERVAL < MAX_PROCEDURE; i++) {
+			stat = &sweepStat[set * ENSEMBLE_POINTS + i];
+			fprintf (fp, "%d,%d,%lld,%lf,%lf\n", set, i * ENSEMBLE_INTERVAL, stat->n, stat->mean, ensembleDeviation (stat));
+		}
+	}
+	fclose (fp);
+
+	return 1;
+}
+
+/* A run that settled early keeps its last value */
+void ensembleTraceFinish () {
+	int i;
+
+	for (i = (stopStep + ENSEMBLE_INTERVAL - 1) / ENSEMBLE_INTERVAL; i < ENSEMBLE_POINTS; i++) {
+		ensembleTrace[i] = totalComeBack () / (double) totalAntCount ();
+	}
+}
+
+/* ------------------------------- CACHE ---------------------------------- */
+
+/* ANTS_CACHE=0 turns the cache off; food typed in by hand is never cached */
+int cacheEnabled () {
+	char *env = getenv ("ANTS_CACHE");
+
+	return isCacheable && DOES_SET_FOOD == 0 && (env == NULL || atoi (env) != 0);
+}
+
+/* 1 if a cached run can stand in for this one: only the series comes from the */
+/* cache, trajectories, heatmaps and the final field are written by the run itself */
+int cacheCoversOutput () {
+	return doesWrite == 0 || (doesTrajectory == 0 && heatmapInterval == 0 && doesSaveField == 0);
+}
+
+/* FNV-1a, continuing from h */
+unsigned long long cacheHash (const void *data, size_t size, unsigned long long h) {
+	const unsigned char *p = (const unsigned char *) data;
+	size_t i;
+
+	for (i = 0; i < size; i++) {
+		h = (h ^ p[i]) * 0x100000001B3ULL;
+	}
+	return h;
+}
+
+/* Defines, colonies, obstacle map, parameters and seed of this run */
+void cacheKeyFill (cacheKey *key, int keySeed) {
+	unsigned char buffer[4096];
+	size_t n;
+	FILE *fp;
+	int c;
+
+	memset (key, 0, sizeof (cacheKey));
+	key->engineVersion = ENGINE_VERSION;
+	key->lMax = L_MAX;
+	key->antNum = ANT_NUM;
+	key->vitality = N;
+	key->foodNum = FOOD_NUM;
+	key->surroundingMode = SURROUNDING_MODE;
+	key->obstacleNum = OBSTACLE_NUM;
+	key->obstacleSurrounding = OBSTACLE_SURROUNDING;
+	key->obstacleMode = OBSTACLE_MODE;
+	key->maxProcedure = MAX_PROCEDURE;
+	key->increment = INCREMENT;
+	key->colonyNum = COLONY_NUM;
+	key->speciesNum = SPECIES_NUM;
+	key->engine = ENGINE;
+	key->meanFieldMode = MEAN_FIELD_MODE;
+	key->ensembleInterval = ENSEMBLE_INTERVAL;
+	key->seed = keySeed;
+	key->isAntithetic = isAntithetic;
+	key->param = param;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		key->colonySetting[c][0] = colonyDefault[c].nestX;
+		key->colonySetting[c][1] = colonyDefault[c].nestY;
+		key->colonySetting[c][2] = colonyDefault[c].population;
+		key->colonySetting[c][3] = colonyDefault[c].species;
+		key->colonyLug[c] = colonyDefault[c].lug;
+	}
+
+	key->obstacleFileHash = 0xCBF29CE484222325ULL;
+	if (OBSTACLE_MODE == 2 && (fp = fopen (OBSTACLE_FILE, "rb")) != NULL) {
+		while ((n = fread (buffer, 1, sizeof (buffer), fp)) > 0) {
+			key->obstacleFileHash = cacheHash (buffer, n, key->obstacleFileHash);
+		}
+		fclose (fp);
+	}
+
+	/* nests, food and obstacles of a scenario are all in its hash */
+	if (scenarioFind ((int) param.scenario) != NULL) {
+		key->scenarioHash = scenarioFind ((int) param.scenario)->hash;
+	}
+	if (warmMap != NULL) {
+		key->warmHash = warmHash;
+		key->warmAnts = doesWarmAnts;
+	}
+}
+
+/* CACHE_DIR/<hash of key><extension> */
+void cachePath (const cacheKey *key, const char *extension, char *path) {
+	sprintf (path, "%s/%016llx%s", CACHE_DIR, cacheHash (key, sizeof (cacheKey), 0xCBF29CE484222325ULL), extension);
+}
+
+/* 1 if a finished run with exactly this key is stored, its trace goes to trace */
+int cacheLoad (const cacheKey *key, cacheRecord *record, double trace[]) {
+	char path[256];
+	FILE *fp;
+	int isOk;
+
+	cachePath (key, ".result", path);
+	if ((fp = fopen (path, "rb")) == NULL) {
+		return 0;
+	}
+
+	isOk = fread (record, sizeof (cacheRecord), 1, fp) == 1
+		&& memcmp (record->magic, "ACRS", 4) == 0
+		&& record->version == CACHE_VERSION
+		&& memcmp (&record->key, key, sizeof (cacheKey)) == 0
+		&& record->tracePoints == ENSEMBLE_POINTS
+		&& fread (trace, sizeof (double), ENSEMBLE_POINTS, fp) == ENSEMBLE_POINTS;
+	fclose (fp);
+
+	return isOk;
+}
+
+/* Puts the final statistics of a stored run back */
+void cacheRestore (const cacheRecord *record) {
+	int c;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		colonyList[c].comeBack = record->comeBack[c];
+		colonyList[c].totalAnt = record->totalAnt[c];
+	}
+	stopStep = record->stopStep;
+	stopReason = record->stopReason;
+}
+
+/* Stores this finished run, and its series when seriesName is given */
+/* files are written under a temporary name and renamed, so readers never see half of one */
+void cacheStore (const cacheKey *key, const double trace[], const char *seriesName) {
+	cacheRecord record;
+	char path[256], tempName[300];
+	FILE *fp;
+	int c, isOk;
+
+	mkdir (CACHE_DIR, 0755);
+
+	if (seriesName != NULL) {
+		cachePath (key, ".series", path);
+		sprintf (tempName, "%s.%d.tmp", path, (int) getpid ());
+		if (cacheCopy (seriesName, tempName) == 0 || rename (tempName, path) != 0) {
+			remove (tempName);
+		}
+	}
+
+	memset (&record, 0, sizeof (record));
+	memcpy (record.magic, "ACRS", 4);
+	record.version = CACHE_VERSION;
+	record.key = *key;
+	record.stopStep = stopStep;
+	record.stopReason = stopReason;
+	record.tracePoints = ENSEMBLE_POINTS;
+	for (c = 0; c < COLONY_NUM; c++) {
+		record.comeBack[c] = colonyList[c].comeBack;
+		record.totalAnt[c] = colonyList[c].totalAnt;
+	}
+
+	cachePath (key, ".result", path);
+	sprintf (tempName, "%s.%d.tmp", path, (int) getpid ());
+	if ((fp = fopen (tempName, "wb")) == NULL) {
+		return;
+	}
+	isOk = fwrite (&record, sizeof (record), 1, fp) == 1 && fwrite (trace, sizeof (double), ENSEMBLE_POINTS, fp) == ENSEMBLE_POINTS;
+	isOk = fclose (fp) == 0 && isOk;
+
+	if (isOk == 0 || rename (tempName, path) != 0) {
+		remove (tempName);
+	}
+}
+
+/* Copies a file, 1 on success */
+int cacheCopy (const char *from, const char *to) {
+	char buffer[4096];
+	FILE *in, *out;
+	size_t n;
+	int isOk = 1;
+
+	if ((in = fopen (from, "rb")) == NULL) {
+		return 0;
+	}
+	if ((out = fopen (to, "wb")) == NULL) {
+		fclose (in);
+		return 0;
+	}
+	while ((n = fread (buffer, 1, sizeof (buffer), in)) > 0) {
+		isOk = isOk && fwrite (buffer, 1, n, out) == n;
+	}
+	fclose (in);
+
+	return fclose (out) == 0 && isOk;
+}
+
+/* ---------------------------- JOB SERVER ------------------------------- */
+
+/* ANTS_SOCKET, or JOB_SOCKET in the working directory */
+const char *jobSocketPath () {
+	char *env = getenv ("ANTS_SOCKET");
+
+	return env != NULL ? env : JOB_SOCKET;
+}
+
+/* Listens until shutdown, then lets the workers finish the queue */
+int jobServe (int workers) {
+	struct sockaddr_un address;
+	struct pollfd listener;
+	pid_t *pid, dead;
+	struct timeval timeout = {1, 0};
+	char line[512];
+	int fd, client, w, k, n, status;
+
+	if (workers <= 0) {
+		workers = sysconf (_SC_NPROCESSORS_ONLN);
+	}
+	if (workers <= 0) {
+		workers = 1;
+	}
+
+	jobList = mmap (NULL, sizeof (job) * JOB_MAX, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	jobCount = mmap (NULL, 2 * sizeof (int), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	pid = calloc (workers, sizeof (pid_t));
+	if (jobList == MAP_FAILED || jobCount == MAP_FAILED || pid == NULL) {
+		printf ("FAILED TO MAP JOBS\n");
+		return 1;
+	}
+	jobStop = jobCount + 1;
+	for (k = 0; k < JOB_MAX; k++) {
+		jobList[k].state = JOB_FREE;
+	}
+
+	memset (&address, 0, sizeof (address));
+	address.sun_family = AF_UNIX;
+	snprintf (address.sun_path, sizeof (address.sun_path), "%s", jobSocketPath ());
+	unlink (address.sun_path);
+	if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0 || bind (fd, (struct sockaddr *) &address, sizeof (address)) != 0 || listen (fd, 16) != 0) {
+		printf ("FAILED TO LISTEN ON %s\n", address.sun_path);
+		return 1;
+	}
+
+	fflush (NULL);
+	for (w = 0; w < workers; w++) {
+		if ((pid[w] = fork ()) == 0) {
+			close (fd);
+			jobWorker (w);
+			_exit (0);
+		}
+	}
+	printf ("serving on %s with %d workers\n", address.sun_path, workers);
+	fflush (stdout);
+
+	listener.fd = fd;
+	listener.events = POLLIN;
+	while (__atomic_load_n (jobStop, __ATOMIC_ACQUIRE) == 0) {
+		if (poll (&listener, 1, 500) > 0 && (client = accept (fd, NULL, NULL)) >= 0) {
+			/* a client that says nothing within a second is dropped */
+			setsockopt (client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof (timeout));
+			setsockopt (client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof (timeout));
+			for (k = 0; k < (int) sizeof (line) - 1 && (n = read (client, line + k, sizeof (line) - 1 - k)) > 0; k += n) {
+				line[k + n] = '\0';
+				if (strchr (line + k, '\n') != NULL) {
+					k += n;
+					break;
+				}
+			}
+			line[k] = '\0';
+			if (k > 0) {
+				jobAnswer (client, line);
+			}
+			close (client);
+		}
+
+		/* a job whose worker died has failed; the worker is replaced */
+		while ((dead = waitpid (-1, &status, WNOHANG)) > 0) {
+			for (w = 0; w < workers && pid[w] != dead; w++);
+			if (w == workers) {
+				continue;
+			}
+			for (k = 0; k < JOB_MAX; k++) {
+				if (jobList[k].state == JOB_RUNNING && jobList[k].worker == w) {
+					jobList[k].state = JOB_FAILED;
+				}
+			}
+			fflush (NULL);
+			if ((pid[w] = fork ()) == 0) {
+				close (fd);
+				jobWorker (w);
+				_exit (0);
+			}
+		}
+	}
+
+	close (fd);
+	unlink (address.sun_path);
+	for (w = 0; w < workers; w++) {
+		waitpid (pid[w], NULL, 0);
+	}
+	free (pid);
+
+	return 0;
+}
+
+/* Worker: takes the oldest queued job; leaves once told to and nothing is queued */
+void jobWorker (int w) {
+	int k, next, queued;
+
+	while (1) {
+		next = -1;
+		for (k = 0; k < JOB_MAX; k++) {
+			if (__atomic_load_n (&jobList[k].state, __ATOMIC_ACQUIRE) == JOB_QUEUED && (next < 0 || jobList[k].id < jobList[next].id)) {
+				next = k;
+			}
+		}
+		if (next < 0) {
+			if (__atomic_load_n (jobStop, __ATOMIC_ACQUIRE)) {
+				return;
+			}
+			usleep (20000);
+			continue;
+		}
+
+		/* another worker may have taken it first */
+		queued = JOB_QUEUED;
+		if (__atomic_compare_exchange_n (&jobList[next].state, &queued, JOB_RUNNING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+			jobList[next].worker = w;
+			jobRun (next);
+		}
+	}
+}
+
+/* Runs the job in slot k in this worker's world, as the CLI would, under the name job<id> */
+void jobRun (int k) {
+	job *j = &jobList[k];
+	double trace[ENSEMBLE_POINTS];
+	long long start = profileClock ();
+	cacheKey key;
+	cacheRecord record;
+	int c;
+
+	param = parameterDefault;
+	parameterApply (j->delta);
+	requestedSeed = j->seed;
+	isAntithetic = 0;
+	doesDraw = 0;
+	isQuiet = 1;
+	doesWrite = j->sinks != 0;
+	doesTrajectory = (j->sinks & JOB_SINK_TRAJECTORY) != 0;
+	heatmapInterval = (j->sinks & JOB_SINK_HEATMAP) ? N : 0;
+	doesSaveField = (j->sinks & JOB_SINK_FIELD) != 0;
+	runLabel = j->runName;
+	ensembleTrace = trace;
+	jobProgress = &j->step;
+
+	/* without files to write, an identical earlier run is enough */
+	cacheKeyFill (&key, requestedSeed);
+	j->isCached = doesWrite == 0 && cacheEnabled () && cacheLoad (&key, &record, trace);
+
+	if (j->isCached) {
+		seed = requestedSeed;
+		cacheRestore (&record);
+	}
+	else {
+		initialization ();
+		if (ENGINE == 1) {
+			meanFieldInitialization ();
+			meanFieldMovement (0, MAX_PROCEDURE);
+		}
+		else {
+			consecutiveMovement (0, MAX_PROCEDURE);
+		}
+
+		trajectoryClose ();
+		heatmapClose ();
+		telemetryClose ();
+		warmSave ();
+		createAndWriteInFile ();
+
+		if (cacheEnabled () && stopStep >= 0) {
+			ensembleTraceFinish ();
+			cacheStore (&key, trace, doesWrite ? seriesFileName : NULL);
+		}
+	}
+	jobProgress = NULL;
+	runLabel = NULL;
+
+	for (c = 0; c < COLONY_NUM; c++) {
+		j->comeBack[c] = colonyList[c].comeBack;
+		j->totalAnt[c] = colonyList[c].totalAnt;
+	}
+	j->homing = totalComeBack () / (double) totalAntCount ();
+	j->stopStep = stopStep;
+	j->stopReason = stopReason;
+	j->seconds = (profileClock () - start) / 1e9;
+
+	__atomic_store_n (&j->state, JOB_DONE, __ATOMIC_RELEASE);
+}
+
+/* One request line: submit <seed> <delta> <sinks>, status [id] or shutdown */
+void jobAnswer (int fd, char *line) {
+	char command[16], delta[256], sinks[64];
+	int k, seed, n, state;
+
+	line[strcspn (line, "\r\n")] = '\0';
+	n = sscanf (line, "%15s %d %255s %63s", command, &seed, delta, sinks);
+
+	if (n >= 1 && strcmp (command, "submit") == 0) {
+		param = parameterDefault;
+		if (n < 4 || jobParseSinks (sinks) < 0 || parameterApply (delta) == 0) {
+			dprintf (fd, "ERROR INVALID JOB %s\n", line);
+			return;
+		}
+		if (param.scenario >= 0 && scenarioFind ((int) param.scenario) == NULL) {
+			dprintf (fd, "ERROR NO SCENARIO %d\n", (int) param.scenario);
+			return;
+		}
+		/* the table keeps the last JOB_MAX jobs; a finished one gives its slot up */
+		k = *jobCount % JOB_MAX;
+		state = __atomic_load_n (&jobList[k].state, __ATOMIC_ACQUIRE);
+		if (state == JOB_QUEUED || state == JOB_RUNNING) {
+			dprintf (fd, "ERROR QUEUE IS FULL\n");
+			return;
+		}
+
+		jobList[k].id = *jobCount;
+		jobList[k].seed = seed;
+		jobList[k].sinks = jobParseSinks (sinks);
+		jobList[k].step = 0;
+		snprintf (jobList[k].delta, sizeof (jobList[k].delta), "%s", delta);
+		sprintf (jobList[k].runName, "job%d", jobList[k].id);
+		__atomic_store_n (&jobList[k].state, JOB_QUEUED, __ATOMIC_RELEASE);
+		*jobCount += 1;
+
+		dprintf (fd, "%d\n", jobList[k].id);
+	}
+	else if (n >= 1 && strcmp (command, "status") == 0) {
+		if (n >= 2) {
+			if (seed < 0 || seed >= *jobCount || seed < *jobCount - JOB_MAX) {
+				dprintf (fd, "ERROR NO JOB %d\n", seed);
+				return;
+			}
+			jobDescribe (fd, seed % JOB_MAX);
+		}
+		else {
+			for (k = *jobCount > JOB_MAX ? *jobCount - JOB_MAX : 0; k < *jobCount; k++) {
+				jobDescribe (fd, k % JOB_MAX);
+			}
+		}
+	}
+	else if (n >= 1 && strcmp (command, "shutdown") == 0) {
+		__atomic_store_n (jobStop, 1, __ATOMIC_RELEASE);
+		for (k = n = 0; k < JOB_MAX; k++) {
+			state = __atomic_load_n (&jobList[k].state, __ATOMIC_ACQUIRE);
+			n += state == JOB_QUEUED || state == JOB_RUNNING;
+		}
+		dprintf (fd, "stopping after %d queued job(s)\n", n);
+	}
+	else {
+		dprintf (fd, "ERROR UNKNOWN REQUEST %s\n", line);
+	}
+}
+
+/* id, state, then progress or results and the files written */
+void jobDescribe (int fd, int k) {
+	job *j = &jobList[k];
+	int state = __atomic_load_n (&j->state, __ATOMIC_ACQUIRE);
+	int c;
+
+	dprintf (fd, "%d %s seed=%d", j->id, jobStateName[state], j->seed);
+	if (state == JOB_RUNNING) {
+		dprintf (fd, " step=%d/%d", j->step, MAX_PROCEDURE);
+	}
+	if (state == JOB_DONE) {
+		dprintf (fd, " homing=%.6lf", j->homing);
+		for (c = 0; c < COLONY_NUM; c++) {
+			dprintf (fd, " %d/%d", j->comeBack[c], j->totalAnt[c]);
+		}
+		dprintf (fd, " stop=%d:%s seconds=%.3lf%s", j->stopStep, j->stopReason >= 0 ? stopReasonName[j->stopReason] : "-", j->seconds, j->isCached ? " cached" : "");
+		if (j->sinks & JOB_SINK_CSV) {
+			dprintf (fd, " %s.csv", j->runName);
+		}
+		if (j->sinks & JOB_SINK_TRAJECTORY) {
+			dprintf (fd, " %s.traj", j->runName);
+		}
+		if (j->sinks & JOB_SINK_HEATMAP) {
+			dprintf (fd, " %s.heat/", j->runName);
+		}
+		if (j->sinks & JOB_SINK_FIELD) {
+			dprintf (fd, " %s.field", j->runName);
+		}
+	}
+	dprintf (fd, "\n");
+}
+
+/* "none" or a comma list of csv, traj, heat and field; -1 if something else is in it */
+int jobParseSinks (const char *text) {
+	const char *names[4] = {"csv", "traj", "heat", "field"};
+	int sinks = 0;
+	int i, n;
+
+	if (strcmp (text, "none") == 0) {
+		return 0;
+	}
+	while (*text != '\0') {
+		n = strcspn (text, ",");
+		for (i = 0; i < 4 && ((int) strlen (names[i]) != n || strncmp (text, names[i], n) != 0); i++);
+		if (i == 4) {
+			return -1;
+		}
+		sinks |= 1 << i;
+		text += n + (text[n] == ',');
+	}
+	return sinks;
+}
+
+/* Sends one line and prints the answer; waiting asks again until the job is over */
+int jobRequest (const char *line, int doesWait) {
+	struct sockaddr_un address;
+	char answer[4096];
+	int fd, k, n, isOver;
+
+	memset (&address, 0, sizeof (address));
+	address.sun_family = AF_UNIX;
+	snprintf (address.sun_path, sizeof (address.sun_path), "%s", jobSocketPath ());
+
+	do {
+		if ((fd = socket (AF_UNIX, SOCK_STREAM, 0)) < 0 || connect (fd, (struct sockaddr *) &address, sizeof (address)) != 0) {
+			printf ("NO SERVER ON %s\n", address.sun_path);
+			if (fd >= 0) {
+				close (fd);
+			}
+			return 0;
+		}
+		dprintf (fd, "%s\n", line);
+		shutdown (fd, SHUT_WR);
+
+		isOver = 1;
+		answer[0] = '\0';
+		if (doesWait) {
+			/* a single status line, which may come in pieces */
+			for (k = 0; k < (int) sizeof (answer) - 1 && (n = read (fd, answer + k, sizeof (answer) - 1 - k)) > 0; k += n);
+			answer[k] = '\0';
+			isOver = strstr (answer, " queued ") == NULL && strstr (answer, " running ") == NULL;
+			if (isOver) {
+				fputs (answer, stdout);
+			}
+		}
+		else {
+			while ((n = read (fd, answer, sizeof (answer) - 1)) > 0) {
+				answer[n] = '\0';
+				fputs (answer, stdout);
+			}
+		}
+		close (fd);
+		if (strncmp (answer, "ERROR", 5) == 0) {
+			return 0;
+		}
+
+		if (isOver == 0) {
+			usleep (200000);
+		}
+	} while (isOver == 0);
+
+	return 1;
+}
+
+/* ------------------------------ LIBRARY -------------------------------- */
+
+/* A world without window or files, as sweep runs have */
+int antsCreate (int seed, const char *delta) {
+	antsDestroy ();
+	arenaInitialization ();
+	scenarioOpen (scenarioLibraryName ());
+	if (warmFileName () != NULL && warmOpen (warmFileName ()) == 0) {
+		return 0;
+	}
+
+	doesDraw = 0;
+	isQuiet = 1;
+	doesWrite = 0;
+	ensembleTrace = NULL;
+	isAntithetic = 0;
+
+	param = parameterDefault;
+	if (delta != NULL && parameterApply (delta) == 0) {
+		return 0;
+	}
+	if (param.scenario >= 0 && scenarioFind ((int) param.scenario) == NULL) {
+		printf ("NO SCENARIO %d IN %s\n", (int) param.scenario, scenarioLibraryName ());
+		return 0;
+	}
+
+	requestedSeed = seed;
+	initialization ();
+	if (ENGINE == 1) {
+		meanFieldInitialization ();
+	}
+	libraryStep = 0;
+
+	return 1;
+}
+
+int antsStep (int steps) {
+	int end = libraryStep + steps;
+	int start = libraryStep;
+
+	if (stopStep >= 0 || steps <= 0) {
+		return 0;
+	}
+	if (end > MAX_PROCEDURE) {
+		end = MAX_PROCEDURE;
+	}
+
+	if (ENGINE == 1) {
+		meanFieldMovement (libraryStep, end);
+	}
+	else {
+		consecutiveMovement (libraryStep, end);
+	}
+	libraryStep = stopStep >= 0 ? stopStep : end;
+
+	return libraryStep - start;
+}
+
+void antsStatistics (antsSummary *out) {
+	modeRatio ();
+
+	out->step = libraryStep;
+	out->stopReason = stopReason;
+	memcpy (out->ratio, ratio, sizeof (ratio));
+	out->comeBack = totalComeBack ();
+	out->totalAnt = totalAntCount ();
+	out->homing = out->totalAnt > 0 ? out->comeBack / (double) out->totalAnt : 0;
+}
+
+int antsFieldStats (int k, double *max, double *sum, int *nonzero) {
+	if (k < 0 || k >= 2 * SPECIES_NUM) {
+		return 0;
+	}
+
+	*max = fieldStats[k].max;
+	*sum = fieldStats[k].sum;
+	*nonzero = fieldStats[k].nonzero;
+	return 1;
+}
+
+void antsFieldView (antsView *out) {
+	out->data = pheromone;
+	out->ndim = 3;
+	out->itemSize = sizeof (double);
+	out->format = "d";
+	out->shape[0] = L_MAX * 2 + 1;
+	out->shape[1] = L_MAX * 2 + 1;
+	out->shape[2] = 2 * SPECIES_NUM;
+	out->strides[0] = sizeof (pheromone[0]);
+	out->strides[1] = sizeof (pheromone[0][0]);
+	out->strides[2] = sizeof (pheromone[0][0][0]);
+}
+
+/* ant holds nothing but ints, so antList reads as an ANT_NUM x columns table */
+void antsAntView (antsView *out) {
+	out->data = antList;
+	out->ndim = 2;
+	out->itemSize = sizeof (int);
+	out->format = "i";
+	out->shape[0] = ANT_NUM;
+	out->shape[1] = sizeof (ant) / sizeof (int);
+	out->shape[2] = 0;
+	out->strides[0] = sizeof (ant);
+	out->strides[1] = sizeof (int);
+	out->strides[2] = 0;
+}
+
+const char *antsAntColumns () {
+	return "x,y,direction,mode,vitality,thresholdOne,thresholdTwo,isSensitive,hasFood,hasComeBack,colony";
+}
+
+void antsDestroy () {
+	trajectoryClose ();
+	heatmapClose ();
+	telemetryClose ();
+}
+
+/* ---------------------------- BENCHMARK -------------------------------- */
+
+/* Times every kernel on a warmed-up headless world, one JSON line each */
+/* L_MAX and ANT_NUM are swept by rebuilding, see bench.sh */
+void benchmark (const char *fileName) {
+	FILE *fp;
+	int a_n, d;
+	long long calls, start;
+	double seconds;
+	double cells = (L_MAX * 2 + 1) * (double) (L_MAX * 2 + 1);
+	double fieldBytes = FIELD_BYTES;
+	static double savedPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	static double savedTempPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	static ant savedAntList[ANT_NUM];
+	float thumbnail[64];
+
+	if ((fp = fopen (fileName, "a")) == NULL) {
+		printf ("FAILED TO CREATE FILE");
+		return;
+	}
+
+	doesDraw = 0;
+	doesProfile = 0;
+	isQuiet = 1;
+	initialization ();
+
+	/* grow the colony and let trails form before timing */
+	for (procedureCount = 0; procedureCount < N * 5 && procedureCount < MAX_PROCEDURE; procedureCount++) {
+		consecutiveStep (procedureCount);
+	}
+
+	memcpy (savedPheromone, pheromone, FIELD_BYTES);
+	memcpy (savedTempPheromone, tempPheromone, FIELD_BYTES);
+	memcpy (savedAntList, antList, sizeof (ant) * ANT_NUM);
+
+	/* diffusion: reads both planes twice, and writes tempPheromone and pheromone */
+	start = profileClock ();
+	for (calls = 0; (seconds = benchmarkSeconds (start)) < BENCH_MIN_TIME; calls++) {
+		pheromoneDiffusion ();
+	}
+	benchmarkReport (fp, "pheromoneDiffusion", calls, seconds, cells, 0, 4 * fieldBytes + sizeof (*passableMask) * (L_MAX * 2 + 1));
+	memcpy (pheromone, savedPheromone, FIELD_BYTES);
+	memcpy (tempPheromone, savedTempPheromone, FIELD_BYTES);
+
+	/* from the same field every call, repeated decay would end in denormals; the copy is not timed */
+	seconds = 0;
+	for (calls = 0; seconds < BENCH_MIN_TIME; calls++) {
+		memcpy (pheromone, savedPheromone, FIELD_BYTES);
+		start = profileClock ();
+		pheormoneEvaporation ();
+		seconds += benchmarkSeconds (start);
+	}
+	benchmarkReport (fp, "pheormoneEvaporation", calls, seconds, cells, 0, 2 * fieldBytes);
+	memcpy (pheromone, savedPheromone, FIELD_BYTES);
+
+	start = profileClock ();
+	for (calls = 0; (seconds = benchmarkSeconds (start)) < BENCH_MIN_TIME; calls++) {
+		normalizePheromone (0);
+		normalizePheromone (1);
+	}
+	benchmarkReport (fp, "normalizePheromone", calls, seconds, cells, 0, 2 * fieldBytes + 2 * sizeof (*normalizedPheromone) * (L_MAX * 2 + 1));
+
+	start = profileClock ();
+	for (calls = 0; (seconds = benchmarkSeconds (start)) < BENCH_MIN_TIME; calls++) {
+		fieldVersion++;
+		pyramidRefresh ();
+	}
+	benchmarkReport (fp, "pyramidRefresh", calls, seconds, cells, 0, fieldBytes + sizeof (*pyramid) * 2 * SPECIES_NUM);
+
+	start = profileClock ();
+	for (calls = 0; (seconds = benchmarkSeconds (start)) < BENCH_MIN_TIME; calls++) {
+		pyramidThumbnail (0, 8, thumbnail);
+	}
+	benchmarkReport (fp, "pyramidThumbnail", calls, seconds, 64, 0, 64 * (sizeof (pyramidBlock) + sizeof (float)));
+
+	/* per ant kernels, one call covers every ant, each in the mode it is in */
+	start = profileClock ();
+	for (calls = 0; (seconds = benchmarkSeconds (start)) < BENCH_MIN_TIME; calls++) {
+		for (a_n = 0; a_n < ANT_NUM; a_n++) {
+			calculateDirection (antList[a_n].mode, antList[a_n].direction, a_n);
+		}
+	}
+	benchmarkReport (fp, "calculateDirection", calls, seconds, 0, ANT_NUM, ANT_NUM * (sizeof (ant) + 6 * sizeof (double)));
+
+	start = profileClock ();
+	for (calls = 0; (seconds = benchmarkSeconds (start)) < BENCH_MIN_TIME; calls++) {
+		for (a_n = 0; a_n < ANT_NUM; a_n++) {
+			checkPheromone (a_n, 1);
+		}
+	}
+	benchmarkReport (fp, "checkPheromone", calls, seconds, 0, ANT_NUM, ANT_NUM * (sizeof (ant) + 6 * sizeof (double)));
+
+	start = profileClock ();
+	for (calls = 0; (seconds = benchmarkSeconds (start)) < BENCH_MIN_TIME; calls++) {
+		d = calls % 6;
+		for (a_n = 0; a_n < ANT_NUM; a_n++) {
+			moveToGivenDirection ((d + a_n) % 6, a_n);
+		}
+	}
+	benchmarkReport (fp, "moveToGivenDirection", calls, seconds, 0, ANT_NUM, ANT_NUM * (sizeof (ant) + 1));
+	memcpy (antList, savedAntList, sizeof (ant) * ANT_NUM);
+
+	/* whole headless procedure */
+	start = profileClock ();
+	for (calls = 0; (seconds = benchmarkSeconds (start)) < BENCH_MIN_TIME && procedureCount < MAX_PROCEDURE; calls++) {
+		consecutiveStep (procedureCount++);
+	}
+	benchmarkReport (fp, "consecutiveStep", calls, seconds, cells, ANT_NUM, 7 * fieldBytes + ANT_NUM * (sizeof (ant) + 18 * sizeof (double)));
+
+	fclose (fp);
+}
+
+/* One JSON line: rates are per second, bytes are nominal bytes touched by one call */
+void benchmarkReport (FILE *fp, const char *kernel, long long calls, double seconds, double cells, double antSteps, double bytes) {
+	if (calls == 0) {
+		return;
+	}
+
+	fprintf (fp, "{\"kernel\":\"%s\",\"L_MAX\":%d,\"ANT_NUM\":%d,\"calls\":%lld,\"nsPerCall\":%.1lf,\"cellsPerSec\":%.4e,\"antStepsPerSec\":%.4e,\"bytesPerStep\":%.0lf}\n", kernel, L_MAX, ANT_NUM, calls, seconds * 1e9 / calls, cells * calls / seconds, antSteps * calls / seconds, bytes);
+	printf ("%-22s %12.1lf ns/call\n", kernel, seconds * 1e9 / calls);
+}
+
+/* Seconds since start */
+double benchmarkSeconds (long long start) {
+	return (profileClock () - start) / 1e9;
+}
+
+# ifndef ANTSTRAIL_LIBRARY
+/* ----------------------------- TEST ------------------------------------ */
+/* Checking if honeycomb is properly generated */
+void graphicTest () {
+	int i, j;
+
+	g_def_scale(1, -L_MAX - 1, L_MAX + 1, - L_MAX - 1, L_MAX + 1, 0, 0, 100.0, 100.0);
+	g_marker_type(1);
+	g_marker_color(0);
+
+	g_sel_scale(1);
+
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			g_marker (coordinate[i][j][0], coordinate[i][j][1]);
+		}
+	}
+}
+# endif
+
+void structAntTest (int a_n) {
+	printf("%d, %d", antList[a_n].x, antList[a_n].y);
+}
+
+/* ------------------------- DIFFERENTIAL TEST --------------------------- */
+
+/* Number of random worlds, and samples for distribution checks */
+# define TEST_TRIAL (20)
+# define TEST_SAMPLE (20000)
+/* Agent runs averaged against the mean field, how far both go, and the margin */
+/* homing counts an ant only when it respawns, so the horizon must be a lot of lifetimes */
+# define TEST_ENGINE_RUN (20)
+# define TEST_ENGINE_STEP (N * 20)
+# define TEST_ENGINE_MARGIN (0.1)
+
+/* Runs every kernel against its reference on random worlds, returns failures */
+/* exact kernels must match bit by bit, sampling kernels must match in distribution */
+int differentialTest () {
+	int trial;
+	int failure = 0;
+
+	doesDraw = 0;
+	isQuiet = 1;
+	initialization ();
+
+	for (trial = 0; trial < TEST_TRIAL; trial++) {
+		randomizeWorld ();
+
+		failure += testResult ("moveToGivenDirection", trial, testMove ());
+		failure += testResult ("surroundingPheromoneAt", trial, testSurrounding ());
+		failure += testResult ("checkPheromone", trial, testCheckPheromone ());
+		failure += testResult ("pheromoneDiffusion", trial, testDiffusion ());
+		failure += testResult ("pheormoneEvaporation", trial, testEvaporation ());
+		failure += testResult ("pyramidRegion", trial, testPyramid ());
+		failure += testResult ("calculateDirection", trial, testDirectionDistribution ());
+	}
+
+	failure += testResult ("meanFieldMovement", 0, testEngineAgreement ());
+
+	printf ("%s: %d failure(s) in %d trials\n", failure == 0 ? "PASSED" : "FAILED", failure, TEST_TRIAL);
+
+	return failure;
+}
+
+/* Random obstacles, pheromone and ants on open cells */
+void randomizeWorld () {
+	int i, j, k, a_n;
+
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			obstaclePlace[i][j] = 0;
+		}
+	}
+	for (k = randomNext () % (L_MAX * 2); k > 0; k--) {
+		placeObstacle (randomNext () % (L_MAX * 2 + 1), randomNext () % (L_MAX * 2 + 1));
+	}
+
+	passableMaskInitialization ();
+	pheromoneInitialization ();
+
+	for (i = 0; i < L_MAX * 2 + 1; i++) {
+		for (j = 0; j < L_MAX * 2 + 1; j++) {
+			if (isOpenCell (i, j) == 0) {
+				continue;
+			}
+			for (k = 0; k < 2 * SPECIES_NUM; k++) {
+				/* a third of cells are empty */
+				if (randomNext () % 3 != 0) {
+					pheromone[i][j][k] = randomNext () / (double) RANDOM_MAX * 100;
+				}
+				tempPheromone[i][j][k] = randomNext () / (double) RANDOM_MAX;
+			}
+		}
+	}
+
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		do {
+			antList[a_n].x = randomNext () % (L_MAX * 2 + 1);
+			antList[a_n].y = randomNext () % (L_MAX * 2 + 1);
+		} while (isOpenCell (antList[a_n].x, antList[a_n].y) == 0);
+
+		antList[a_n].direction = randomNext () % 6;
+		antList[a_n].mode = randomNext () % 3 + 1;
+		antList[a_n].threshold[0] = randomNext () % 100;
+		antList[a_n].threshold[1] = randomNext () % 100;
+	}
+}
+
+/* Prints failures only */
+int testResult (const char *name, int trial, int isOk) {
+	if (isOk) {
+		return 0;
+	}
+
+	printf ("FAIL %s (trial %d)\n", name, trial);
+	return 1;
+}
+
+/* Every ant, every direction */
+int testMove () {
+	int a_n, dir;
+	ant expected;
+	ant saved;
+
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		saved = antList[a_n];
+
+		for (dir = 0; dir < 6; dir++) {
+			antList[a_n] = saved;
+			referenceMove (dir, a_n);
+			expected = antList[a_n];
+
+			antList[a_n] = saved;
+			moveToGivenDirection (dir, a_n);
+
+			if (antList[a_n].x != expected.x || antList[a_n].y != expected.y || antList[a_n].direction != expected.direction) {
+				antList[a_n] = saved;
+				return 0;
+			}
+		}
+
+		antList[a_n] = saved;
+	}
+
+	return 1;
+}
+
+/* Every ant, every plane */
+int testSurrounding () {
+	int a_n, k, d;
+	int expected[6], actual[6];
+
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		for (k = 0; k < 2 * SPECIES_NUM; k++) {
+			referenceSurrounding (a_n, k, expected);
+			surroundingPheromoneAt (antList[a_n].x, antList[a_n].y, k, actual);
+
+			for (d = 0; d < 6; d++) {
+				if (expected[d] != actual[d]) {
+					return 0;
+				}
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* Every ant, both pheromones */
+int testCheckPheromone () {
+	int a_n, k;
+
+	for (a_n = 0; a_n < ANT_NUM; a_n++) {
+		for (k = 0; k < 2; k++) {
+			if (referenceCheckPheromone (a_n, k) != checkPheromone (a_n, k)) {
+				return 0;
+			}
+		}
+	}
+
+	return 1;
+}
+
+/* Same input field, bit-exact output of both planes */
+int testDiffusion () {
+	static double inputPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	static double inputTempPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	static double expectedPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	static double expectedTempPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	int isOk;
+
+	memcpy (inputPheromone, pheromone, FIELD_BYTES);
+	memcpy (inputTempPheromone, tempPheromone, FIELD_BYTES);
+
+	referenceDiffusion ();
+	memcpy (expectedPheromone, pheromone, FIELD_BYTES);
+	memcpy (expectedTempPheromone, tempPheromone, FIELD_BYTES);
+
+	memcpy (pheromone, inputPheromone, FIELD_BYTES);
+	memcpy (tempPheromone, inputTempPheromone, FIELD_BYTES);
+	pheromoneDiffusion ();
+
+	isOk = memcmp (expectedPheromone, pheromone, FIELD_BYTES) == 0 && memcmp (expectedTempPheromone, tempPheromone, FIELD_BYTES) == 0;
+
+	memcpy (pheromone, inputPheromone, FIELD_BYTES);
+	memcpy (tempPheromone, inputTempPheromone, FIELD_BYTES);
+
+	return isOk;
+}
+
+/* Same input field, bit-exact output */
+int testEvaporation () {
+	static double inputPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	static double expectedPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	int isOk;
+
+	memcpy (inputPheromone, pheromone, FIELD_BYTES);
+
+	referenceEvaporation ();
+	memcpy (expectedPheromone, pheromone, FIELD_BYTES);
+
+	memcpy (pheromone, inputPheromone, FIELD_BYTES);
+	pheormoneEvaporation ();
+
+	isOk = memcmp (expectedPheromone, pheromone, FIELD_BYTES) == 0;
+
+	memcpy (pheromone, inputPheromone, FIELD_BYTES);
+
+	return isOk;
+}
+
+/* Random regions against a scan of the field, after a full and an incremental refresh */
+/* sums agree within 1e-9 relative, max and open cells exactly */
+int testPyramid () {
+	static double inputPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	static double inputTempPheromone[L_MAX * 2 + 1][L_MAX * 2 + 1][2 * SPECIES_NUM];
+	pyramidBlock got;
+	double sum, max;
+	int round, q, k, x0, y0, x1, y1, px, py, cells;
+	int isOk = 1;
+
+	memcpy (inputPheromone, pheromone, FIELD_BYTES);
+	memcpy (inputTempPheromone, tempPheromone, FIELD_BYTES);
+	fieldStatUpdate ();
+
+	for (round = 0; round < 2; round++) {
+		/* the second round checks the incremental path after one diffusion and evaporation */
+		if (round == 1) {
+			pyramidRefresh ();
+			pheromoneDiffusion ();
+			pheormoneEvaporation ();
+		}
+
+		for (q = 0; q < 20; q++) {
+			k = randomNext () % (2 * SPECIES_NUM);
+			x0 = randomNext () % (L_MAX * 2 + 1);
+			y0 = randomNext () % (L_MAX * 2 + 1);
+			x1 = x0 + randomNext () % (L_MAX * 2 + 1 - x0);
+			y1 = y0 + randomNext () % (L_MAX * 2 + 1 - y0);
+
+			sum = 0;
+			max = 0;
+			cells = 0;
+			for (px = x0; px <= x1; px++) {
+				for (py = y0; py <= y1; py++) {
+					if (isOpenCell (px, py)) {
+						cells++;
+						if (pheromone[px][py][k] > 0) {
+							sum += pheromone[px][py][k];
+							max = fmax (max, pheromone[px][py][k]);
+						}
+					}
+				}
+			}
+
+			pyramidRegion (k, x0, y0, x1, y1, &got);
+			isOk &= fabs (got.sum - sum) <= 1e-9 * fmax (1, sum) && got.max == max && got.cells == cells;
+		}
+	}
+
+	memcpy (pheromone, inputPheromone, FIELD_BYTES);
+	memcpy (tempPheromone, inputTempPheromone, FIELD_BYTES);
+	fieldStatUpdate ();
+
+	return isOk;
+}
+
+/* Sampled directions against the cone probabilities worked out by the reference */
+/* agreement is a total variation distance below 0.02 */
+int testDirectionDistribution () {
+	int a_n = randomNext () % ANT_NUM;
+	int mode = randomNext () % 3 + 1;
+	int dir = antList[a_n].direction;
+	int plane = 2 * colonyList[antList[a_n].colony].species + (mode == 2 ? 1 : 0);
+	int count[6] = {0, 0, 0, 0, 0, 0};
+	int i, k;
+	double expected[6];
+	double distance = 0;
+
+	referenceDirection (a_n, mode, plane, expected);
+
+	for (i = 0; i < TEST_SAMPLE; i++) {
+		k = calculateDirection (mode, dir, a_n);
+		if (k < 0 || k > 5) {
+			return 0;
+		}
+		count[k]++;
+	}
+
+	for (k = 0; k < 6; k++) {
+		distance += fabs (count[k] / (double) TEST_SAMPLE - expected[k]);
+	}
+
+	return distance / 2 < 0.02;
+}
+
+/* Mode shares among the ants out and the homing rate, agent runs against the mean field */
+/* the mean field must lie within three standard errors of the agent mean, plus a */
+/* margin for what a mean field leaves out */
+int testEngineAgreement () {
+	double agent[TEST_ENGINE_RUN][4];
+	double field[4], mean, sd, sum;
+	double (*savedDensity)[L_MAX * 2 + 1][L_MAX * 2 + 1][3][6] = density;
+	double (*savedNextDensity)[L_MAX * 2 + 1][L_MAX * 2 + 1][3][6] = nextDensity;
+	int savedSeed = requestedSeed;
+	int r, m, a_n, out;
+	int isOk = 1;
+
+	doesWrite = 0;
+
+	for (r = 0; r < TEST_ENGINE_RUN; r++) {
+		requestedSeed = r + 1;
+		initialization ();
+		consecutiveMovement (0, TEST_ENGINE_STEP);
+
+		out = 0;
+		for (m = 0; m < 4; m++) {
+			agent[r][m] = 0;
+		}
+		for (a_n = 0; a_n < ANT_NUM; a_n++) {
+			if (antIsOut (a_n)) {
+				agent[r][antList[a_n].mode - 1] ++;
+				out++;
+			}
+		}
+		for (m = 0; m < 3; m++) {
+			agent[r][m] /= out > 0 ? out : 1;
+		}
+		agent[r][3] = totalComeBack () / (double) totalAntCount ();
+	}
+
+	/* the agent engine has no densities of its own */
+	if (ENGINE == 0) {
+		density = calloc (COLONY_NUM, sizeof (*density));
+		nextDensity = calloc (COLONY_NUM, sizeof (*nextDensity));
+		if (density == NULL || nextDensity == NULL) {
+			printf ("CANNOT ALLOCATE MEAN FIELD\n");
+			free (density);
+			free (nextDensity);
+			density = savedDensity;
+			nextDensity = savedNextDensity;
+			return 0;
+		}
+	}
+
+	requestedSeed = 1;
+	initialization ();
+	meanFieldInitialization ();
+	meanFieldMovement (0, TEST_ENGINE_STEP);
+	meanFieldRatio ();
+
+	sum = ratio[0] + ratio[1] + ratio[2];
+	for (m = 0; m < 3; m++) {
+		field[m] = ratio[m] / (sum > 0 ? sum : 1);
+	}
+	field[3] = 0;
+	sum = 0;
+	for (m = 0; m < COLONY_NUM; m++) {
+		field[3] += meanFieldComeBack[m];
+		sum += meanFieldTotal[m];
+	}
+	field[3] /= sum;
+
+	if (ENGINE == 0) {
+		free (density);
+		free (nextDensity);
+		density = savedDensity;
+		nextDensity = savedNextDensity;
+	}
+	requestedSeed = savedSeed;
+
+	for (m = 0; m < 4; m++) {
+		mean = 0;
+		for (r = 0; r < TEST_ENGINE_RUN; r++) {
+			mean += agent[r][m];
+		}
+		mean /= TEST_ENGINE_RUN;
+
+		sd = 0;
+		for (r = 0; r < TEST_ENGINE_RUN; r++) {
+			sd += (agent[r][m] - mean) * (agent[r][m] - mean);
+		}
+		sd = sqrt (sd / (TEST_ENGINE_RUN - 1));
+
+		if (fabs (field[m] - mean) > 3 * sd / sqrt (TEST_ENGINE_RUN) + TEST_ENGINE_MARGIN) {
+			printf ("%s: agent %.3lf (sd %.3lf), mean field %.3lf\n", m < 3 ? "MODE SHARE" : "HOMING", mean, sd, field[m]);
+			isOk = 0;
+		}
+	}
+
+	return isOk;
+}
+
+/* Reference kernels: plain coordinate tests, no masks */
+int referenceOpen (int x, int y) {
+	if (x < 0 || x > L_MAX * 2 || y < 0 || y > L_MAX * 2) {
+		return 0;
+	}
+	return coordinate[x][y][0] <= L_MAX && obstaclePlace[x][y] == 0;
+}
+
+void referenceMove (int dir, int a_n) {
+	int x = antList[a_n].x;
+	int y = antList[a_n].y;
+
+	/* Up */
+	if (dir == 0) {
+		if (referenceOpen (x - 1, y)) {
+			antList[a_n].x --;
+		}
+	}
+	/* Right up */
+	else if (dir == 1) {
+		if (referenceOpen (x - 1, y + 1)) {
+			antList[a_n].x --;
+			antList[a_n].y ++;
+		}
+	}
+	/* Right down */
+	else if (dir == 2) {
+		if (referenceOpen (x, y + 1)) {
+			antList[a_n].y ++;
+		}
+	}
+	/* Down */
+	else if (dir == 3) {
+		if (referenceOpen (x + 1, y)) {
+			antList[a_n].x ++;
+		}
+	}
+	/* Left down */
+	else if (dir == 4) {
+		if (referenceOpen (x + 1, y - 1)) {
+			antList[a_n].x ++;
+			antList[a_n].y --;
+		}
+	}
+	/* Left up */
+	else if (dir == 5) {
+		if (referenceOpen (x, y - 1)) {
+			antList[a_n].y --;
+		}
+	}
+	else {
+		return;
+	}
+
+	antList[a_n].direction = dir;
+}
+
+void referenceSurrounding (int a_n, int plane, int surroundingPheromone[6]) {
+	int x = antList[a_n].x;
+	int y = antList[a_n].y;
+	int i;
+
+	for (i = 0; i < 6; i++) {
+		surroundingPheromone[i] = 1;
+	}
+
+	if (referenceOpen (x - 1, y)) {
+		surroundingPheromone[0] += (int)INCREMENT * pheromone[x - 1][y][plane];
+	}
+	if (referenceOpen (x - 1, y + 1)) {
+		surroundingPheromone[1] += (int)INCREMENT * pheromone[x - 1][y + 1][plane];
+	}
+	if (referenceOpen (x, y + 1)) {
+		surroundingPheromone[2] += (int)INCREMENT * pheromone[x][y + 1][plane];
+	}
+	if (referenceOpen (x + 1, y)) {
+		surroundingPheromone[3] += (int)INCREMENT * pheromone[x + 1][y][plane];
+	}
+	if (referenceOpen (x + 1, y - 1)) {
+		surroundingPheromone[4] += (int)INCREMENT * pheromone[x + 1][y - 1][plane];
+	}
+	if (referenceOpen (x, y - 1)) {
+		surroundingPheromone[5] += (int)INCREMENT * pheromone[x][y - 1][plane];
+	}
+}
+
+int referenceCheckPheromone (int a_n, int pheromone_num) {
+	int x = antList[a_n].x;
+	int y = antList[a_n].y;
+	int plane = 2 * colonyList[antList[a_n].colony].species + pheromone_num;
+	int threshold = antList[a_n].threshold[pheromone_num];
+
+	if (referenceOpen (x, y - 1) && pheromone[x][y - 1][plane] >= threshold) {
+		return 1;
+	}
+	if (referenceOpen (x + 1, y - 1) && pheromone[x + 1][y - 1][plane] >= threshold) {
+		return 1;
+	}
+	if (referenceOpen (x + 1, y) && pheromone[x + 1][y][plane] >= threshold) {
+		return 1;
+	}
+	if (referenceOpen (x, y + 1) && pheromone[x][y + 1][plane] >= threshold) {
+		return 1;
+	}
+	if (referenceOpen (x - 1, y + 1) && pheromone[x - 1][y + 1][plane] >= threshold) {
+		return 1;
+	}
+	if (referenceOpen (x - 1, y) && pheromone[x - 1][y][plane] >= threshold) {
+		return 1;
+	}
+	return 0;
+}
+
+/* Probability of each direction: a third for each of the three ahead in mode 1, */
+/* otherwise in proportion to exp (16 * pheromone / largest pheromone around), */
+/* where an overflowed (negative) reading counts as RANDOM_MAX */
+void referenceDirection (int a_n, int mode, int plane, double probability[6]) {
+	int surroundingPheromone[6];
+	double weight[6], max = 0, sum = 0;
+	int d;
+
+	referenceSurrounding (a_n, plane, surroundingPheromone);
+
+	for (d = 0; d < 6; d++) {
+		if (surroundingPheromone[d] < 0) {
+			surroundingPheromone[d] = RANDOM_MAX;
+		}
+		if (surroundingPheromone[d] > max) {
+			max = surroundingPheromone[d];
+		}
+	}
+
+	for (d = 0; d < 6; d++) {
+		probability[d] = 0;
+
+		/* only the direction it faces and the two next to it */
+		if (d != antList[a_n].direction && d != (antList[a_n].direction + 1) % 6 && d != (antList[a_n].direction + 5) % 6) {
+			weight[d] = 0;
+		}
+		else if (mode == 1) {
+			weight[d] = 1;
+		}
+		else {
+			weight[d] = floor (exp (16 * surroundingPheromone[d] / max));
+		}
+		sum += weight[d];
+	}
+
+	for (d = 0; d < 6; d++) {
+		probability[d] = weight[d] / sum;
+	}
+}
+
+/* Gathers into each cell on its own, from its neighbors in scan order; the model */
+/* takes six times the share of the last cell holding pheromone one, in scan order, */
+/* out of every cell that received some, and that cell is looked up here directly */
+void referenceDiffusion () {
+	/* neighbors in the order a scan over (px, py) reaches them */
+	const int fromX[6] = {-1, -1, 0, 0, 1, 1};
+	const int fromY[6] = {0, 1, -1, 1, -1, 0};
+	int px, py, qx, qy, k, n, lastX, lastY;
+	double lastOne, lastTwo;
+
+	for (k = 0; k < SPECIES_NUM; k++) {
+		lastX = -1;
+		lastY = -1;
+		for (px = L_MAX * 2; px >= 0 && lastX < 0; px--) {
+			for (py = L_MAX * 2; py >= 0 && lastX < 0; py--) {
+				if (pheromone[px][py][2 * k] > 0) {
+					lastX = px;
+					lastY = py;
+				}
+			}
+		}
+		lastOne = lastX < 0 ? 0 : pheromone[lastX][lastY][2 * k] * param.diffusionCoefOne;
+		lastTwo = lastX < 0 ? 0 : pheromone[lastX][lastY][2 * k + 1] * param.diffusionCoefTwo;
+
+		for (px = 0; px <= L_MAX * 2; px++) {
+			for (py = 0; py <= L_MAX * 2; py++) {
+				if (referenceOpen (px, py) == 0) {
+					continue;
+				}
+				for (n = 0; n < 6; n++) {
+					qx = px + fromX[n];
+					qy = py + fromY[n];
+					if (qx < 0 || qx > L_MAX * 2 || qy < 0 || qy > L_MAX * 2 || pheromone[qx][qy][2 * k] <= 0) {
+						continue;
+					}
+					tempPheromone[px][py][2 * k] += pheromone[qx][qy][2 * k] * param.diffusionCoefOne;
+					tempPheromone[px][py][2 * k + 1] += pheromone[qx][qy][2 * k + 1] * param.diffusionCoefTwo;
+				}
+			}
+		}
+
+		for (px = 0; px <= L_MAX * 2; px++) {
+			for (py = 0; py <= L_MAX * 2; py++) {
+				if (tempPheromone[px][py][2 * k] > 0) {
+					pheromone[px][py][2 * k] -= 6 * lastOne;
+					pheromone[px][py][2 * k + 1] -= 6 * lastTwo;
+
+					pheromone[px][py][2 * k] += tempPheromone[px][py][2 * k];
+					pheromone[px][py][2 * k + 1] += tempPheromone[px][py][2 * k + 1];
+				}
+			}
+		}
+	}
+}
+
+void referenceEvaporation () {
+	int px, py, k;
+
+	for (k = 0; k < SPECIES_NUM; k++) {
+		for (px = 0; px <= L_MAX * 2; px++) {
+			for (py = 0; py <= L_MAX * 2; py++) {
+				if (pheromone[px][py][2 * k] > 0) {
+					pheromone[px][py][2 * k] *= param.evaporateCoefOne;
+					pheromone[px][py][2 * k + 1] *= param.evaporateCoefTwo;
+				}
+			}
+		}
+	}
 }
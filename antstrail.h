@@ -0,0 +1,73 @@
+/*
+ *
+ * ANTSTRAIL AS A LIBRARY
+ *
+ * Build antstrail.c with -DANTSTRAIL_LIBRARY (no main) as a
+ * shared library and drive the simulation from other code.
+ * There is one world per process, set up by antsCreate.
+ *
+ * The views point straight into the simulation's arrays, so
+ * host code (NumPy through ctypes, for example) can wrap them
+ * without copying. They stay valid for the life of the process,
+ * and they change whenever antsStep runs. Do not write through
+ * them.
+ *
+ */
+
+# ifndef ANTSTRAIL_H
+# define ANTSTRAIL_H
+
+/* Built with -fvisibility=hidden, the library exports only what is marked ANTS_API */
+# if defined (ANTSTRAIL_LIBRARY) && defined (__GNUC__)
+# define ANTS_API __attribute__ ((visibility ("default")))
+# else
+# define ANTS_API
+# endif
+
+/* A read-only n-dimensional array: strides are in bytes, as in the buffer protocol */
+typedef struct {
+	const void *data;
+	int ndim;
+	int itemSize;
+	/* "d" for double, "i" for int */
+	const char *format;
+	long shape[3];
+	long strides[3];
+} antsView;
+
+/* Where the run is, summed over colonies */
+typedef struct {
+	int step;
+	/* -1 while running, then 0 (max procedure) or 1 (converged) */
+	int stopReason;
+	int ratio[3];
+	int comeBack;
+	int totalAnt;
+	double homing;
+} antsSummary;
+
+/* Resets the world for seed (< 0 takes the time) with a parameter delta */
+/* such as "evaporateCoefOne=0.99" or NULL; 0 if the delta is invalid */
+ANTS_API int antsCreate (int seed, const char *delta);
+
+/* Runs up to steps steps and returns how many ran, 0 once the run has stopped */
+ANTS_API int antsStep (int steps);
+
+ANTS_API void antsStatistics (antsSummary *out);
+
+/* max, sum and nonzero cells of pheromone plane k as of the last step, 0 if no such plane */
+ANTS_API int antsFieldStats (int k, double *max, double *sum, int *nonzero);
+
+/* pheromone[x][y][plane]: doubles, negative outside the field and on obstacles */
+ANTS_API void antsFieldView (antsView *out);
+
+/* ants[n][column]: ints, columns are named by antsAntColumns */
+ANTS_API void antsAntView (antsView *out);
+
+/* comma separated column names of antsAntView */
+ANTS_API const char *antsAntColumns ();
+
+/* Stops any writer threads of the current world */
+ANTS_API void antsDestroy ();
+
+# endif
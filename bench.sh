@@ -0,0 +1,22 @@
+#!/bin/sh
+#
+# Builds antstrail for every L_MAX and ANT_NUM below and appends
+# the kernel timings to bench.jsonl (one JSON line per kernel).
+#
+# usage: ./bench.sh [output file]
+#
+
+OUT=${1:-bench.jsonl}
+CC=${CC:-cc}
+CFLAGS=${CFLAGS:--O2}
+LIBS=${LIBS:--lglsc -lX11 -lm -lpthread -lrt}
+
+for L in 30 100 300; do
+	for A in 50 1000 10000; do
+		$CC $CFLAGS -DL_MAX=$L -DANT_NUM=$A -DSET_SEED=1 antstrail.c $LIBS -o antstrail_bench || exit 1
+		echo "L_MAX=$L ANT_NUM=$A"
+		./antstrail_bench bench "$OUT"
+	done
+done
+
+rm -f antstrail_bench